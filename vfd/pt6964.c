@@ -4,7 +4,17 @@
  */
 
 #include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/version.h>
 #include <linux/gpio.h>
+#include <linux/ktime.h>
+
+// gpiod_set_raw_array_value() appeared in 4.3
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
+#  define HAVE_GPIOD_ARRAY
+#  include <linux/gpio/consumer.h>
+#  include <linux/gpio/driver.h>
+#endif
 
 #include "pt6964.h"
 
@@ -18,15 +28,47 @@ static inline void STB(struct vfd_t *vfd, int value)
 	gpio_set_value(vfd->gpio[GPIO_STB], value);
 }
 
-static inline void DO(struct vfd_t *vfd, int value)
+// Switch DI/DO to output mode, if it's not already
+static inline void DO_OUT(struct vfd_t *vfd)
 {
-	if (vfd->dido_gpio_out)
-		gpio_set_value(vfd->gpio[GPIO_DIDO], value);
-	else
-	{
+	if (!vfd->dido_gpio_out) {
 		vfd->dido_gpio_out = 1;
-		gpio_direction_output(vfd->gpio[GPIO_DIDO], value);
+		gpio_direction_output(vfd->gpio[GPIO_DIDO], 1);
+	}
+}
+
+// Set CLK and DO at once; assumes DI/DO is in output mode
+static inline void CLK_DO(struct vfd_t *vfd, int clk, int value)
+{
+#ifdef HAVE_GPIOD_ARRAY
+	if (vfd->gpiod_array) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+		unsigned long bits = (clk ? 1 : 0) | (value ? 2 : 0);
+		gpiod_set_raw_array_value(2, &vfd->gpiod[GPIO_CLK], NULL, &bits);
+#else
+		int values [2] = { clk, value };
+		gpiod_set_raw_array_value(2, &vfd->gpiod[GPIO_CLK], values);
+#endif
+		return;
 	}
+#endif
+
+	gpio_set_value(vfd->gpio[GPIO_CLK], clk);
+	gpio_set_value(vfd->gpio[GPIO_DIDO], value);
+}
+
+// Wait the rest of CLK pulse width
+static inline void BUS_DELAY(struct vfd_t *vfd)
+{
+	if (vfd->bus_delay_ns)
+		ndelay(vfd->bus_delay_ns);
+}
+
+// Wait the rest of STB pulse width
+static inline void STB_DELAY(struct vfd_t *vfd)
+{
+	if (vfd->stb_delay_ns)
+		ndelay(vfd->stb_delay_ns);
 }
 
 static inline int DI(struct vfd_t *vfd)
@@ -44,12 +86,14 @@ static inline int DI(struct vfd_t *vfd)
 static void pt6964_send(struct vfd_t *vfd, u8 data)
 {
 	int i;
+
+	DO_OUT(vfd);
 	for (i = 8; i != 0; i--, data >>= 1) {
-		CLK(vfd, 0);
-		DO(vfd, data & 1);
-		ndelay(400);
+		// data is latched on rising CLK edge, so it's safe to change both at once
+		CLK_DO(vfd, 0, data & 1);
+		BUS_DELAY(vfd);
 		CLK(vfd, 1);
-		ndelay(400);
+		BUS_DELAY(vfd);
 	}
 }
 
@@ -58,7 +102,16 @@ static void pt6964_cmd(struct vfd_t *vfd, u8 cmd)
 	STB(vfd, 0);
 	pt6964_send(vfd, cmd);
 	STB(vfd, 1);
-	udelay(1);
+	STB_DELAY(vfd);
+}
+
+// Make sure the chip is in given data setting mode
+static void pt6964_data_mode(struct vfd_t *vfd, u8 cmd)
+{
+	if (vfd->data_cmd != cmd) {
+		pt6964_cmd(vfd, cmd);
+		vfd->data_cmd = cmd;
+	}
 }
 
 // Clear display RAM
@@ -68,14 +121,14 @@ static void pt6964_clear_dram(struct vfd_t *vfd)
 
 	DBG_TRACE;
 
-	pt6964_cmd(vfd, CMD_DATA_SETTING(1, 0));
+	pt6964_data_mode(vfd, CMD_DATA_SETTING(1, 0));
 
 	STB(vfd, 0);
 	pt6964_send(vfd, CMD_ADDRESS_SET(0));
 	for (i = 0; i < RAW_DISPLAY_WORDS * 2; i++)
 		pt6964_send(vfd, 0);
 	STB(vfd, 1);
-	udelay(1);
+	STB_DELAY(vfd);
 }
 
 #ifndef CONFIG_VFD_NO_KEY_INPUT
@@ -88,11 +141,11 @@ static u8 pt6964_read(struct vfd_t *vfd)
 	for (i = 1; i < 0x100; i <<= 1)
 	{
 		CLK(vfd, 0);
-		ndelay(400);
+		BUS_DELAY(vfd);
 		if (DI(vfd))
 			d |= i;
 		CLK(vfd, 1);
-		ndelay(400);
+		BUS_DELAY(vfd);
 	}
 
 	return d;
@@ -110,7 +163,8 @@ u32 hardware_keys(struct vfd_t *vfd)
 
 	// read data command
 	pt6964_send(vfd, CMD_DATA_SETTING (0, 1));
-	udelay (1);
+	vfd->data_cmd = CMD_DATA_SETTING (0, 1);
+	STB_DELAY(vfd);
 
 #if defined COMPAT_FD620
         /*
@@ -147,13 +201,13 @@ u32 hardware_keys(struct vfd_t *vfd)
 
 	for (i = 0; i < 20; i += 4) {
 		u32 x = pt6964_read (vfd);
-		x = (x & 0x03) | ((x & 18) >> 1);
+		x = (x & 0x03) | ((x & 0x18) >> 1);
 		keys |= (x << i);
 	}
 #endif
 
 	STB (vfd, 1);
-	udelay(1);
+	STB_DELAY(vfd);
 
 	return keys;
 }
@@ -163,68 +217,95 @@ u32 hardware_keys(struct vfd_t *vfd)
 void hardware_update_brightness(struct vfd_t *vfd)
 {
 	int bri = !vfd->enabled ? 0 :
-		vfd->suspended ? vfd->brightness_suspend :
+		vfd->suspended ? vfd->brightness_frame :
 		vfd->brightness;
 
 	DBG_PRINT ("%d\n", bri);
 
-	if (bri == 0)
-		pt6964_cmd(vfd, CMD_DISPLAY_CONTROL(0, 0));
-	else
-		pt6964_cmd(vfd, CMD_DISPLAY_CONTROL(1, bri - 1));
+	u8 ctrl = (bri == 0) ? CMD_DISPLAY_CONTROL(0, 0) :
+		CMD_DISPLAY_CONTROL(1, bri - 1);
+
+	// don't resend the same display control command
+	if (ctrl == vfd->last_ctrl)
+		return;
+
+	pt6964_cmd(vfd, ctrl);
+	vfd->last_ctrl = ctrl;
 }
 
 void hardware_suspend(struct vfd_t *vfd, int enable)
 {
 	DBG_TRACE;
 	vfd->suspended = enable;
+	// the chip may have lost its state while suspended
+	if (!enable)
+		vfd->data_cmd = vfd->last_ctrl = 0;
 	hardware_update_brightness(vfd);
 }
 
+/*
+ * Write changed display RAM bytes, planning the transfer by the number of
+ * bits clocked. Every changed byte costs 8 bits, every STB cycle costs an
+ * address byte plus the strobe overhead, so a gap of unchanged bytes is
+ * bridged (rewritten) when that is cheaper than starting a new cycle.
+ *
+ * Fixed-address mode is never used: a fixed-address write of a single byte
+ * costs exactly the same as an auto-increment run of one byte, so it could
+ * only win by saving a mode switch, which auto-increment runs need just
+ * as rarely.
+ */
 void hardware_update_display(struct vfd_t *vfd)
 {
-	unsigned i, pofs = 0x6964;
-	u16 raw [ARRAY_SIZE(vfd->raw_display)];
+	unsigned i, start, end, gap;
+	u8 old [RAW_DISPLAY_WORDS * 2], new [RAW_DISPLAY_WORDS * 2];
 
 	//DBG_TRACE;
 
-	if (vfd->display_to_raw)
-		vfd->display_to_raw (vfd, vfd->display, raw);
-
-	for (i = 0; i < ARRAY_SIZE(vfd->raw_display); i++)
-		raw [i] |= vfd->raw_overlay [i];
+	// render text only if it changed since last time
+	if (!vfd->raw_text_valid ||
+	    memcmp (vfd->raw_text_display, vfd->shadow_display, sizeof (vfd->raw_text_display))) {
+		if (vfd->display_to_raw)
+			vfd->display_to_raw (vfd, vfd->shadow_display, vfd->raw_text);
+		memcpy (vfd->raw_text_display, vfd->shadow_display, sizeof (vfd->raw_text_display));
+		vfd->raw_text_valid = 1;
+	}
 
-	// update on-chip display RAM
+	// display RAM is little-endian
 	for (i = 0; i < ARRAY_SIZE(vfd->raw_display); i++) {
-		u16 r = raw [i];
-
-		if (r == vfd->raw_display [i])
-			continue;
-
+		u16 r = vfd->raw_text [i] | vfd->shadow_overlay [i];
+		old [i * 2] = vfd->raw_display [i] & 0xff;
+		old [i * 2 + 1] = vfd->raw_display [i] >> 8;
+		new [i * 2] = r & 0xff;
+		new [i * 2 + 1] = r >> 8;
 		vfd->raw_display [i] = r;
+	}
 
-		if (pofs == 0x6964) {
-			// initialize write mode with auto-increment
-			pt6964_cmd(vfd, CMD_DATA_SETTING(1, 0));
-		} else if (pofs != (i - 1)) {
-			// terminate previous command
-			STB(vfd, 1);
-			udelay(1);
+	for (start = 0; start < sizeof (new); start = end) {
+		// find next changed byte
+		if (new [start] == old [start]) {
+			end = start + 1;
+			continue;
 		}
 
-		if (pofs != (i - 1)) {
-			STB(vfd, 0);
-			pt6964_send(vfd, CMD_ADDRESS_SET(i * 2));
+		// extend the run while bridging gaps is cheaper than a new cycle
+		for (end = start + 1, gap = 0; end + gap < sizeof (new); ) {
+			if (new [end + gap] == old [end + gap])
+				gap++;
+			else if (gap * 8 < 8 + STB_CYCLE_BITS) {
+				end += gap + 1;
+				gap = 0;
+			} else
+				break;
 		}
-		pofs = i;
 
-		pt6964_send(vfd, r & 0xff);
-		pt6964_send(vfd, r >> 8);
-	}
+		pt6964_data_mode(vfd, CMD_DATA_SETTING(1, 0));
 
-	if (pofs != 0x6964) {
+		STB(vfd, 0);
+		pt6964_send(vfd, CMD_ADDRESS_SET(start));
+		for (i = start; i < end; i++)
+			pt6964_send(vfd, new [i]);
 		STB(vfd, 1);
-		udelay(1);
+		STB_DELAY(vfd);
 	}
 }
 
@@ -237,6 +318,36 @@ static const u8 platform_cellno [7] = PLATFORM_CELLNO;
 static const u8 platform_cellbit [PLATFORM_DISPLAY_LEN] = PLATFORM_CELLBIT;
 #endif
 
+/*
+ * Measure how long a GPIO write takes and insert only the delays still
+ * needed to meet the datasheet timings. Delays set from DT (>= 0) are
+ * left alone. Must be called with STB high, so the chip ignores CLK.
+ */
+static void __init pt6964_calibrate(struct vfd_t *vfd)
+{
+	int i, round;
+	s64 ns, write_ns = S64_MAX;
+
+	// take the best of several rounds to filter out preemption & interrupts
+	for (round = 0; round < CALIBRATE_ROUNDS; round++) {
+		ktime_t start = ktime_get();
+		for (i = 0; i < CALIBRATE_WRITES; i++)
+			CLK(vfd, i & 1);
+		ns = div_s64(ktime_to_ns(ktime_sub(ktime_get(), start)), CALIBRATE_WRITES);
+		if (ns < write_ns)
+			write_ns = ns;
+	}
+
+	// every pulse ends with a GPIO write, which counts towards its width
+	if (vfd->bus_delay_ns < 0)
+		vfd->bus_delay_ns = (write_ns < T_CLK_NS) ? T_CLK_NS - write_ns : 0;
+	if (vfd->stb_delay_ns < 0)
+		vfd->stb_delay_ns = (write_ns < T_STB_NS) ? T_STB_NS - write_ns : 0;
+
+	printk(KERN_INFO "vfd: gpio write takes %lld ns, bus delay %d ns, strobe delay %d ns\n",
+		write_ns, vfd->bus_delay_ns, vfd->stb_delay_ns);
+}
+
 int __init hardware_init(struct vfd_t *vfd)
 {
 	DBG_TRACE;
@@ -254,6 +365,19 @@ int __init hardware_init(struct vfd_t *vfd)
 	vfd_init_glyphs_ca (vfd, platform_cellno, platform_cellbit);
 #endif
 
+#ifdef HAVE_GPIOD_ARRAY
+	// if CLK and DI/DO are on the same GPIO chip which can set several
+	// pins with a single register write, toggle them together
+	vfd->gpiod[GPIO_CLK] = gpio_to_desc(vfd->gpio[GPIO_CLK]);
+	vfd->gpiod[GPIO_DIDO] = gpio_to_desc(vfd->gpio[GPIO_DIDO]);
+	if (vfd->gpiod[GPIO_CLK] && vfd->gpiod[GPIO_DIDO]) {
+		struct gpio_chip *chip = gpiod_to_chip(vfd->gpiod[GPIO_CLK]);
+		vfd->gpiod_array = (chip == gpiod_to_chip(vfd->gpiod[GPIO_DIDO])) &&
+			(chip->set_multiple != NULL);
+	}
+	DBG_PRINT ("gpiod array fast path %s\n", vfd->gpiod_array ? "enabled" : "disabled");
+#endif
+
 	// set up GPIO modes
 	gpio_direction_output(vfd->gpio [GPIO_STB], 1);
 	gpio_direction_output(vfd->gpio [GPIO_CLK], 1);
@@ -261,6 +385,8 @@ int __init hardware_init(struct vfd_t *vfd)
 
 	udelay(10);
 
+	pt6964_calibrate(vfd);
+
 	pt6964_clear_dram(vfd);
 	pt6964_cmd(vfd, CMD_DISPLAY_MODE(PLATFORM_DISPLAY_MODE));
 	hardware_update_brightness(vfd);
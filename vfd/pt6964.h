@@ -38,6 +38,20 @@
 // Enable display and set display brightness (0-7)
 #define CMD_DISPLAY_CONTROL(en,bri)	(0x80 | ((en) ? 8 : 0) | (bri))
 
+// Minimal CLK pulse width (both high & low), ns
+#define T_CLK_NS			400
+// Minimal STB pulse width and the minimal wait after a command, ns
+#define T_STB_NS			1000
+
+// The cost of an extra STB cycle (toggles & strobe delay) in bit clocks,
+// used when planning display RAM writes
+#define STB_CYCLE_BITS			2
+
+// Number of GPIO writes to time in a single calibration round
+#define CALIBRATE_WRITES		32
+// Number of calibration rounds, the fastest one is used
+#define CALIBRATE_ROUNDS		4
+
 // 8 brighness levels 0..7 (0 is lowest brightness, not off)
 #define BRIGHTNESS_MAX			7
 
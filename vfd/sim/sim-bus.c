@@ -0,0 +1,272 @@
+/*
+ * Simulated GPIO bus with a PT6964 protocol decoder.
+ * Copyright (c) 2017 Andrew Zabolotny <zapparello@ya.ru>
+ *
+ * The decoder watches the bit-banged STB/CLK/DIO waveform the same way
+ * the real chip does: a byte is shifted in LSB first on every rising CLK
+ * edge while STB is low, the first byte after STB goes low is a command,
+ * following bytes are data. Key data is shifted out on DIO while the
+ * driver has it in input mode after a "read key data" command.
+ */
+
+#include "sim.h"
+#include "../vfd-priv.h"
+
+struct sim_bus_stats_t sim_bus;
+struct sim_chip_t sim_chip;
+
+/* the bus state as seen by the chip */
+static struct {
+	/* signal levels */
+	int stb, clk, dio;
+	/* 1 if the driver has DIO in output mode */
+	int dio_out;
+	/* bits received or sent in current byte */
+	int bit;
+	/* the byte being received */
+	u8 byte;
+	/* number of bytes since STB went low */
+	int index;
+	/* the command starting current STB cycle */
+	u8 cmd;
+	/* data setting: read keys, fixed address */
+	int read, fixed;
+	/* current display RAM address */
+	u8 addr;
+	/* number of key bytes sent in current read cycle */
+	int read_index;
+} bus = { 1, 1, 1, 0 };
+
+/* Return the key data byte as the chip would send it */
+static u8 key_byte (int n)
+{
+	u32 keys = sim_chip.keys;
+
+#if defined COMPAT_FD620
+	// KS(n+1) at bit 0 & 3
+	return ((keys >> (2 * n)) & 1) | (((keys >> (2 * n + 1)) & 1) << 3);
+#else
+	// KS(2n+1)/K1,K2 at bits 0,1; KS(2n+2)/K1,K2 at bits 3,4
+	return ((keys >> (4 * n)) & 3) | (((keys >> (4 * n + 2)) & 3) << 3);
+#endif
+}
+
+static void bus_error (const char *msg)
+{
+	sim_bus.errors++;
+	printk ("sim: bus error: %s\n", msg);
+}
+
+/* A byte has been received from the driver */
+static void bus_byte (u8 byte)
+{
+	sim_bus.bytes++;
+
+	if (bus.index++ == 0) {
+		sim_bus.commands++;
+		bus.cmd = byte;
+
+		switch (byte & 0xc0) {
+			case 0x00:
+				sim_chip.display_mode = byte & 3;
+				break;
+
+			case 0x40:
+				bus.read = (byte & 2) != 0;
+				bus.fixed = (byte & 4) != 0;
+				bus.read_index = 0;
+				break;
+
+			case 0x80:
+				sim_chip.display_on = (byte & 8) != 0;
+				sim_chip.brightness = byte & 7;
+				break;
+
+			case 0xc0:
+				bus.addr = byte & 0x0f;
+				break;
+		}
+		return;
+	}
+
+	/* data bytes are only valid after an address set */
+	if ((bus.cmd & 0xc0) != 0xc0) {
+		bus_error ("data byte without address set");
+		return;
+	}
+
+	sim_chip.ram [bus.addr] = byte;
+	if (!bus.fixed)
+		bus.addr = (bus.addr + 1) & 0x0f;
+}
+
+static void bus_clk (int value)
+{
+	int rising = !bus.clk && value;
+
+	bus.clk = value;
+	if (!rising || bus.stb)
+		return;
+
+	if (!bus.dio_out) {
+		/* the driver is reading key data */
+		if (!bus.read || (bus.index == 0))
+			bus_error ("read without read command");
+		if (++bus.bit == 8) {
+			bus.bit = 0;
+			bus.read_index++;
+			sim_bus.bytes++;
+		}
+		return;
+	}
+
+	bus.byte |= (bus.dio & 1) << bus.bit;
+	if (++bus.bit == 8) {
+		bus_byte (bus.byte);
+		bus.bit = 0;
+		bus.byte = 0;
+	}
+}
+
+static void bus_stb (int value)
+{
+	if (bus.stb && !value) {
+		/* start of a new command */
+		bus.index = 0;
+		bus.bit = 0;
+		bus.byte = 0;
+	} else if (!bus.stb && value && bus.bit)
+		bus_error ("STB raised in the middle of a byte");
+
+	bus.stb = value;
+}
+
+int gpio_request (unsigned gpio, const char *label)
+{
+	return 0;
+}
+
+/* set one signal, without counting a GPIO write */
+static void bus_set (unsigned gpio, int value)
+{
+	value = value ? 1 : 0;
+
+	switch (gpio) {
+		case SIM_GPIO_STB:
+			bus_stb (value);
+			break;
+
+		case SIM_GPIO_CLK:
+			bus_clk (value);
+			break;
+
+		case SIM_GPIO_DIDO:
+			if (!bus.dio_out)
+				bus_error ("DIO written in input mode");
+			bus.dio = value;
+			break;
+	}
+}
+
+void gpio_set_value (unsigned gpio, int value)
+{
+	sim_bus.gpio_writes++;
+	bus_set (gpio, value);
+}
+
+int gpio_get_value (unsigned gpio)
+{
+	sim_bus.gpio_reads++;
+
+	if (gpio != SIM_GPIO_DIDO)
+		return 0;
+
+	if (bus.dio_out) {
+		bus_error ("DIO read in output mode");
+		return bus.dio;
+	}
+
+	/* the chip shifts data out on falling CLK edge */
+	return (key_byte (bus.read_index) >> bus.bit) & 1;
+}
+
+int gpio_direction_input (unsigned gpio)
+{
+	sim_bus.gpio_writes++;
+	if (gpio == SIM_GPIO_DIDO)
+		bus.dio_out = 0;
+	return 0;
+}
+
+int gpio_direction_output (unsigned gpio, int value)
+{
+	if (gpio == SIM_GPIO_DIDO)
+		bus.dio_out = 1;
+	gpio_set_value (gpio, value);
+	return 0;
+}
+
+static struct gpio_desc sim_gpio_desc [] = {
+	{ SIM_GPIO_STB }, { SIM_GPIO_CLK }, { SIM_GPIO_DIDO },
+};
+
+static void sim_set_multiple (struct gpio_chip *chip, unsigned long *mask, unsigned long *bits)
+{
+}
+
+static struct gpio_chip sim_gpio_chip = {
+	.set_multiple = sim_set_multiple,
+};
+
+struct gpio_desc *gpio_to_desc (unsigned gpio)
+{
+	if ((gpio < SIM_GPIO_STB) || (gpio > SIM_GPIO_DIDO))
+		return NULL;
+	return &sim_gpio_desc [gpio - SIM_GPIO_STB];
+}
+
+struct gpio_chip *gpiod_to_chip (const struct gpio_desc *desc)
+{
+	return &sim_gpio_chip;
+}
+
+/* all the signals change with a single register write */
+static void bus_set_array (unsigned array_size, struct gpio_desc **desc_array, const int *values)
+{
+	unsigned i;
+
+	sim_bus.gpio_writes++;
+
+	for (i = 0; i < array_size; i++)
+		if ((desc_array [i]->gpio == SIM_GPIO_CLK) && !bus.clk && values [i] &&
+		    (array_size > 1))
+			bus_error ("CLK raised together with other signals");
+
+	/* data settles before CLK is looked at */
+	for (i = 0; i < array_size; i++)
+		if (desc_array [i]->gpio != SIM_GPIO_CLK)
+			bus_set (desc_array [i]->gpio, values [i]);
+	for (i = 0; i < array_size; i++)
+		if (desc_array [i]->gpio == SIM_GPIO_CLK)
+			bus_set (desc_array [i]->gpio, values [i]);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+int gpiod_set_raw_array_value (unsigned array_size, struct gpio_desc **desc_array,
+	struct gpio_array *array_info, unsigned long *value_bitmap)
+{
+	int values [BITS_PER_LONG];
+	unsigned i;
+
+	for (i = 0; i < array_size; i++)
+		values [i] = (*value_bitmap >> i) & 1;
+	bus_set_array (array_size, desc_array, values);
+	return 0;
+}
+#else
+void gpiod_set_raw_array_value (unsigned array_size, struct gpio_desc **desc_array,
+	int *value_array)
+{
+	bus_set_array (array_size, desc_array, value_array);
+}
+#endif
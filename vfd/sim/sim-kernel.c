@@ -0,0 +1,481 @@
+/*
+ * Userspace implementation of the kernel APIs used by the VFD driver.
+ * Copyright (c) 2017 Andrew Zabolotny <zapparello@ya.ru>
+ */
+
+#include <time.h>
+
+#include "sim.h"
+
+int sim_verbose;
+unsigned long jiffies;
+u64 sim_delay_ns;
+u64 sim_cpu_ns;
+u64 sim_key_events;
+
+struct platform_device sim_pdev = {
+	.name = "meson-vfd",
+	.dev = { .kobj = { .name = "meson-vfd" } },
+};
+
+struct miscdevice *sim_misc;
+
+static struct device_node sim_of_node;
+static struct platform_driver *sim_driver;
+static struct delayed_work *sim_works;
+
+#define SIM_MAX_ATTRS		32
+static const struct device_attribute *sim_attrs [SIM_MAX_ATTRS];
+static const struct bin_attribute *sim_bin_attrs [SIM_MAX_ATTRS];
+
+/* nesting level of sim_cpu_begin() */
+static int sim_cpu_level;
+static struct timespec sim_cpu_start;
+
+//***//***//***//***//***//***// misc //***//***//***//***//***//***//
+
+char *skip_spaces (const char *str)
+{
+	while (isspace (*str))
+		str++;
+	return (char *)str;
+}
+
+int kstrtouint (const char *s, unsigned base, unsigned *res)
+{
+	char *endp;
+	unsigned long val;
+
+	errno = 0;
+	val = strtoul (s, &endp, base);
+	if ((endp == s) || errno || (val > 0xffffffffUL))
+		return -EINVAL;
+	if (*endp == '\n')
+		endp++;
+	if (*endp)
+		return -EINVAL;
+
+	*res = val;
+	return 0;
+}
+
+unsigned long get_zeroed_page (int gfp)
+{
+	void *page;
+
+	if (posix_memalign (&page, PAGE_SIZE, PAGE_SIZE) != 0)
+		return 0;
+	memset (page, 0, PAGE_SIZE);
+	return (unsigned long)page;
+}
+
+void free_page (unsigned long addr)
+{
+	free ((void *)addr);
+}
+
+ktime_t ktime_get (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (s64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void sim_cpu_begin (void)
+{
+	if (sim_cpu_level++ == 0)
+		clock_gettime (CLOCK_THREAD_CPUTIME_ID, &sim_cpu_start);
+}
+
+void sim_cpu_end (void)
+{
+	struct timespec now;
+
+	if (--sim_cpu_level != 0)
+		return;
+
+	clock_gettime (CLOCK_THREAD_CPUTIME_ID, &now);
+	sim_cpu_ns += (now.tv_sec - sim_cpu_start.tv_sec) * 1000000000LL +
+		(now.tv_nsec - sim_cpu_start.tv_nsec);
+}
+
+//***//***//***//***//***//***// work queues //***//***//***//***//***//***//
+
+void sim_init_delayed_work (struct delayed_work *dwork, void (*func) (struct work_struct *))
+{
+	struct delayed_work *cur;
+
+	dwork->work.func = func;
+	dwork->pending = 0;
+
+	for (cur = sim_works; cur; cur = cur->next)
+		if (cur == dwork)
+			return;
+
+	dwork->next = sim_works;
+	sim_works = dwork;
+}
+
+struct workqueue_struct *alloc_ordered_workqueue (const char *name, unsigned flags)
+{
+	struct workqueue_struct *wq = calloc (1, sizeof (struct workqueue_struct));
+	wq->name = name;
+	return wq;
+}
+
+void destroy_workqueue (struct workqueue_struct *wq)
+{
+	free (wq);
+}
+
+bool queue_delayed_work (struct workqueue_struct *wq, struct delayed_work *dwork,
+	unsigned long delay)
+{
+	if (dwork->pending)
+		return false;
+
+	dwork->pending = 1;
+	dwork->expires = jiffies + delay;
+	return true;
+}
+
+bool mod_delayed_work (struct workqueue_struct *wq, struct delayed_work *dwork,
+	unsigned long delay)
+{
+	bool ret = dwork->pending;
+
+	dwork->pending = 1;
+	dwork->expires = jiffies + delay;
+	return ret;
+}
+
+bool cancel_delayed_work_sync (struct delayed_work *dwork)
+{
+	bool ret = dwork->pending;
+	dwork->pending = 0;
+	return ret;
+}
+
+/* run all works which are due; returns the number of works run */
+static int sim_run_works (void)
+{
+	struct delayed_work *cur;
+	int count = 0, again = 1;
+
+	while (again) {
+		again = 0;
+		for (cur = sim_works; cur; cur = cur->next)
+			if (cur->pending && !time_before (jiffies, cur->expires)) {
+				cur->pending = 0;
+				sim_cpu_begin ();
+				cur->work.func (&cur->work);
+				sim_cpu_end ();
+				count++;
+				again = 1;
+			}
+	}
+
+	return count;
+}
+
+void sim_advance (unsigned ms)
+{
+	sim_run_works ();
+	while (ms--) {
+		jiffies++;
+		sim_run_works ();
+	}
+}
+
+//***//***//***//***//***//***// device model //***//***//***//***//***//***//
+
+int kobject_uevent_env (struct kobject *kobj, int action, char *envp [])
+{
+	int i;
+
+	for (i = 0; envp [i]; i++)
+		printk ("uevent %s: %s\n", kobj->name, envp [i]);
+	return 0;
+}
+
+int device_create_file (struct device *dev, const struct device_attribute *attr)
+{
+	int i;
+
+	for (i = 0; i < SIM_MAX_ATTRS; i++)
+		if (!sim_attrs [i]) {
+			sim_attrs [i] = attr;
+			return 0;
+		}
+
+	return -ENOMEM;
+}
+
+void device_remove_file (struct device *dev, const struct device_attribute *attr)
+{
+	int i;
+
+	for (i = 0; i < SIM_MAX_ATTRS; i++)
+		if (sim_attrs [i] == attr)
+			sim_attrs [i] = NULL;
+}
+
+int device_create_bin_file (struct device *dev, const struct bin_attribute *attr)
+{
+	int i;
+
+	for (i = 0; i < SIM_MAX_ATTRS; i++)
+		if (!sim_bin_attrs [i]) {
+			sim_bin_attrs [i] = attr;
+			return 0;
+		}
+
+	return -ENOMEM;
+}
+
+void device_remove_bin_file (struct device *dev, const struct bin_attribute *attr)
+{
+	int i;
+
+	for (i = 0; i < SIM_MAX_ATTRS; i++)
+		if (sim_bin_attrs [i] == attr)
+			sim_bin_attrs [i] = NULL;
+}
+
+static const struct device_attribute *sim_find_attr (const char *name)
+{
+	int i;
+
+	for (i = 0; i < SIM_MAX_ATTRS; i++)
+		if (sim_attrs [i] && (strcmp (sim_attrs [i]->attr.name, name) == 0))
+			return sim_attrs [i];
+
+	return NULL;
+}
+
+ssize_t sim_attr_store (const char *name, const char *value)
+{
+	const struct device_attribute *attr = sim_find_attr (name);
+	ssize_t ret;
+
+	if (!attr || !attr->store)
+		return -ENOENT;
+
+	sim_cpu_begin ();
+	ret = attr->store (&sim_pdev.dev, (struct device_attribute *)attr, value, strlen (value));
+	sim_cpu_end ();
+
+	return ret;
+}
+
+ssize_t sim_attr_show (const char *name, char *buf)
+{
+	const struct device_attribute *attr = sim_find_attr (name);
+
+	if (!attr || !attr->show)
+		return -ENOENT;
+
+	return attr->show (&sim_pdev.dev, (struct device_attribute *)attr, buf);
+}
+
+ssize_t sim_bin_write (const char *name, const void *data, size_t size)
+{
+	int i;
+	ssize_t ret;
+	char buf [PAGE_SIZE];
+
+	for (i = 0; i < SIM_MAX_ATTRS; i++)
+		if (sim_bin_attrs [i] && (strcmp (sim_bin_attrs [i]->attr.name, name) == 0))
+			break;
+
+	if (i >= SIM_MAX_ATTRS)
+		return -ENOENT;
+
+	/* like sysfs, hand the data to the driver in a kernel buffer */
+	memcpy (buf, data, size);
+
+	sim_cpu_begin ();
+	ret = sim_bin_attrs [i]->write (NULL, &sim_pdev.dev.kobj,
+		(struct bin_attribute *)sim_bin_attrs [i], buf, 0, size);
+	sim_cpu_end ();
+
+	return ret;
+}
+
+int platform_driver_register (struct platform_driver *drv)
+{
+	sim_driver = drv;
+	sim_pdev.dev.of_node = &sim_of_node;
+	/* the simulated device always matches */
+	return drv->probe (&sim_pdev);
+}
+
+int sim_suspend (void)
+{
+	pm_message_t state = { 0 };
+	return sim_driver->suspend (&sim_pdev, state);
+}
+
+int sim_resume (void)
+{
+	return sim_driver->resume (&sim_pdev);
+}
+
+void platform_driver_unregister (struct platform_driver *drv)
+{
+	if (drv->remove)
+		drv->remove (&sim_pdev);
+	sim_driver = NULL;
+}
+
+//***//***//***//***//***//***// device tree //***//***//***//***//***//***//
+
+void sim_set_properties (struct property *props, int count)
+{
+	sim_of_node.properties = props;
+	sim_of_node.count = count;
+}
+
+struct property *of_find_property (const struct device_node *np, const char *name, int *lenp)
+{
+	int i;
+
+	for (i = 0; i < np->count; i++)
+		if (strcmp (np->properties [i].name, name) == 0) {
+			if (lenp)
+				*lenp = np->properties [i].length;
+			return &np->properties [i];
+		}
+
+	return NULL;
+}
+
+int of_property_count_strings (struct device_node *np, const char *propname)
+{
+	struct property *prop = of_find_property (np, propname, NULL);
+	const char *cur, *end;
+	int count = 0;
+
+	if (!prop)
+		return -EINVAL;
+
+	cur = prop->value;
+	end = cur + prop->length;
+	for (; cur < end; cur += strlen (cur) + 1)
+		count++;
+
+	return count;
+}
+
+int of_property_read_string_index (struct device_node *np, const char *propname,
+	int index, const char **output)
+{
+	struct property *prop = of_find_property (np, propname, NULL);
+	const char *cur, *end;
+
+	if (!prop)
+		return -EINVAL;
+
+	cur = prop->value;
+	end = cur + prop->length;
+	for (; cur < end; cur += strlen (cur) + 1)
+		if (index-- == 0) {
+			*output = cur;
+			return 0;
+		}
+
+	return -ENODATA;
+}
+
+int of_property_read_string (struct device_node *np, const char *propname,
+	const char **out_string)
+{
+	return of_property_read_string_index (np, propname, 0, out_string);
+}
+
+int of_property_read_u32 (const struct device_node *np, const char *propname, u32 *out_value)
+{
+	struct property *prop = of_find_property (np, propname, NULL);
+	const u8 *val;
+
+	if (!prop)
+		return -EINVAL;
+	if (prop->length < 4)
+		return -EOVERFLOW;
+
+	/* DT cells are big-endian */
+	val = prop->value;
+	*out_value = (val [0] << 24) | (val [1] << 16) | (val [2] << 8) | val [3];
+	return 0;
+}
+
+int of_get_named_gpio_flags (struct device_node *np, const char *list_name,
+	int index, enum of_gpio_flags *flags)
+{
+	static const int gpios [] = { SIM_GPIO_STB, SIM_GPIO_CLK, SIM_GPIO_DIDO };
+
+	if ((strcmp (list_name, "gpios") != 0) || (index >= ARRAY_SIZE (gpios)))
+		return -ENOENT;
+
+	return gpios [index];
+}
+
+//***//***//***//***//***//***// input //***//***//***//***//***//***//
+
+struct input_dev *input_allocate_device (void)
+{
+	return calloc (1, sizeof (struct input_dev));
+}
+
+int input_register_device (struct input_dev *dev)
+{
+	return 0;
+}
+
+void input_free_device (struct input_dev *dev)
+{
+	free (dev);
+}
+
+void input_report_key (struct input_dev *dev, unsigned code, int value)
+{
+	printk ("key %u %s\n", code, value ? "down" : "up");
+	sim_key_events++;
+}
+
+void input_sync (struct input_dev *dev)
+{
+}
+
+//***//***//***//***//***//***// character device //***//***//***//***//***//
+
+loff_t noop_llseek (struct file *file, loff_t offset, int whence)
+{
+	return 0;
+}
+
+loff_t default_llseek (struct file *file, loff_t offset, int whence)
+{
+	/* the simulation never seeks */
+	return -EINVAL;
+}
+
+int remap_pfn_range (struct vm_area_struct *vma, unsigned long addr,
+	unsigned long pfn, unsigned long size, pgprot_t prot)
+{
+	/* the simulation has a single address space */
+	vma->vm_start = pfn << PAGE_SHIFT;
+	return 0;
+}
+
+int misc_register (struct miscdevice *misc)
+{
+	sim_misc = misc;
+	return 0;
+}
+
+int misc_deregister (struct miscdevice *misc)
+{
+	sim_misc = NULL;
+	return 0;
+}
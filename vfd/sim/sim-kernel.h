@@ -0,0 +1,439 @@
+/*
+ * A thin userspace shim of the kernel APIs used by the VFD driver.
+ * Copyright (c) 2017 Andrew Zabolotny <zapparello@ya.ru>
+ *
+ * This header is force-included (gcc -include) into every driver source,
+ * while all the <linux/...> and <asm/...> headers the driver includes are
+ * generated empty by the makefile. Only what the driver actually uses is
+ * provided, and only as far as a single-threaded simulation needs it.
+ */
+
+#ifndef __SIM_KERNEL_H__
+#define __SIM_KERNEL_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* pretend to be the vendor kernel the driver was written for,
+ * unless the makefile asks for another one */
+#define KERNEL_VERSION(a,b,c)	(((a) << 16) + ((b) << 8) + (c))
+#ifdef SIM_KERNEL
+/* SIM_KERNEL is a comma separated triplet, expanded before KERNEL_VERSION sees it */
+#  define __SIM_KERNEL_VERSION(v)	KERNEL_VERSION(v)
+#  define LINUX_VERSION_CODE	__SIM_KERNEL_VERSION(SIM_KERNEL)
+#else
+#  define LINUX_VERSION_CODE	KERNEL_VERSION(3,14,29)
+#endif
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef long long s64;
+typedef unsigned long long u64;
+
+#define S64_MAX			INT64_MAX
+#define BITS_PER_LONG		(8 * sizeof (long))
+
+#define __init
+#define __exit
+#define __user
+#define __iomem
+
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+
+#define ARRAY_SIZE(a)		(sizeof (a) / sizeof ((a) [0]))
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof (type, member)))
+
+#define min(a, b)		({ typeof (a) _a = (a); typeof (b) _b = (b); _a < _b ? _a : _b; })
+#define max(a, b)		({ typeof (a) _a = (a); typeof (b) _b = (b); _a > _b ? _a : _b; })
+
+#define div_s64(a, b)		((s64)(a) / (b))
+
+static inline u16 be16_to_cpup (const u16 *p)
+{
+	const u8 *b = (const u8 *)p;
+	return (b [0] << 8) | b [1];
+}
+
+/* --- printing --- */
+
+#define KERN_ERR		""
+#define KERN_INFO		""
+
+extern int sim_verbose;
+#define printk(fmt, ...) \
+	(sim_verbose ? fprintf (stderr, fmt, ##__VA_ARGS__) : 0)
+#define dev_err(dev, fmt, ...)	printk (fmt, ##__VA_ARGS__)
+#define dev_info(dev, fmt, ...)	printk (fmt, ##__VA_ARGS__)
+
+/* --- strings --- */
+
+extern char *skip_spaces (const char *str);
+extern int kstrtouint (const char *s, unsigned base, unsigned *res);
+#define simple_strtoul		strtoul
+
+/* --- memory --- */
+
+#define GFP_KERNEL		0
+#define PAGE_SHIFT		12
+#define PAGE_SIZE		(1UL << PAGE_SHIFT)
+
+#define kmalloc(size, gfp)	malloc (size)
+#define kzalloc(size, gfp)	calloc (1, size)
+#define kfree(ptr)		free (ptr)
+extern unsigned long get_zeroed_page (int gfp);
+extern void free_page (unsigned long addr);
+#define virt_to_phys(ptr)	((unsigned long)(ptr))
+
+/* pages are not reference counted, free_page() frees at once */
+struct page;
+#define virt_to_page(ptr)	((struct page *)(ptr))
+#define get_page(page)		((void)(page))
+#define put_page(page)		((void)(page))
+
+#define copy_to_user(to, from, n)	(memcpy (to, from, n), 0)
+#define copy_from_user(to, from, n)	(memcpy (to, from, n), 0)
+#define get_user(x, ptr)		({ (x) = *(ptr); 0; })
+
+/* --- bit operations --- */
+
+static inline void set_bit (int nr, volatile unsigned long *addr)
+{
+	addr [nr / BITS_PER_LONG] |= 1UL << (nr % BITS_PER_LONG);
+}
+
+static inline int test_and_clear_bit (int nr, volatile unsigned long *addr)
+{
+	unsigned long mask = 1UL << (nr % BITS_PER_LONG);
+	int old = (addr [nr / BITS_PER_LONG] & mask) != 0;
+	addr [nr / BITS_PER_LONG] &= ~mask;
+	return old;
+}
+
+/* --- locking: the simulation is single-threaded --- */
+
+struct mutex { int locked; };
+#define mutex_init(m)		((m)->locked = 0)
+#define mutex_lock(m)		((m)->locked++)
+#define mutex_unlock(m)		((m)->locked--)
+
+typedef struct { unsigned sequence; } seqlock_t;
+#define seqlock_init(sl)	((sl)->sequence = 0)
+#define write_seqlock(sl)	((sl)->sequence++)
+#define write_sequnlock(sl)	((sl)->sequence++)
+#define read_seqbegin(sl)	((sl)->sequence)
+#define read_seqretry(sl, seq)	((sl)->sequence != (seq))
+
+struct kref { int refcount; };
+#define kref_init(kr)		((kr)->refcount = 1)
+#define kref_get(kr)		((kr)->refcount++)
+#define kref_put(kr, release)	(--(kr)->refcount == 0 ? (release) (kr), 1 : 0)
+
+/* --- time --- */
+
+#define HZ			1000
+extern unsigned long jiffies;
+#define msecs_to_jiffies(ms)	((unsigned long)(ms) * HZ / 1000)
+#define time_before(a, b)	((long)((a) - (b)) < 0)
+
+typedef s64 ktime_t;
+extern ktime_t ktime_get (void);
+#define ktime_sub(a, b)		((a) - (b))
+#define ktime_to_ns(kt)		(kt)
+#define ktime_to_ms(kt)		((kt) / 1000000)
+/* the simulated wall clock starts at the epoch and follows jiffies */
+#define ktime_get_real()	((ktime_t)jiffies * 1000000)
+
+static inline u64 div_u64_rem (u64 dividend, u32 divisor, u32 *remainder)
+{
+	*remainder = dividend % divisor;
+	return dividend / divisor;
+}
+
+/* delays are not really spent, but accounted as bus time */
+extern u64 sim_delay_ns;
+#define ndelay(ns)		(sim_delay_ns += (ns))
+#define udelay(us)		(sim_delay_ns += (us) * 1000ULL)
+
+/* --- work queues: delayed works are run by sim_advance() --- */
+
+struct work_struct {
+	void (*func) (struct work_struct *work);
+};
+
+struct delayed_work {
+	struct work_struct work;
+	unsigned long expires;
+	int pending;
+	struct delayed_work *next;
+};
+
+struct workqueue_struct { const char *name; };
+
+#define to_delayed_work(w)	container_of(w, struct delayed_work, work)
+#define INIT_DELAYED_WORK(dw, fn) sim_init_delayed_work (dw, fn)
+
+extern void sim_init_delayed_work (struct delayed_work *dwork, void (*func) (struct work_struct *));
+extern struct workqueue_struct *alloc_ordered_workqueue (const char *name, unsigned flags);
+extern void destroy_workqueue (struct workqueue_struct *wq);
+extern bool queue_delayed_work (struct workqueue_struct *wq, struct delayed_work *dwork,
+	unsigned long delay);
+extern bool mod_delayed_work (struct workqueue_struct *wq, struct delayed_work *dwork,
+	unsigned long delay);
+extern bool cancel_delayed_work_sync (struct delayed_work *dwork);
+
+/* --- device model & sysfs --- */
+
+struct kobject { const char *name; };
+
+#define KOBJ_CHANGE		2
+extern int kobject_uevent_env (struct kobject *kobj, int action, char *envp []);
+
+struct device_node;
+
+struct device {
+	struct kobject kobj;
+	struct device *parent;
+	struct device_node *of_node;
+	void *driver_data;
+};
+
+#define dev_get_drvdata(dev)	((dev)->driver_data)
+
+struct attribute {
+	const char *name;
+	unsigned short mode;
+};
+
+struct device_attribute {
+	struct attribute attr;
+	ssize_t (*show) (struct device *dev, struct device_attribute *attr, char *buf);
+	ssize_t (*store) (struct device *dev, struct device_attribute *attr,
+		const char *buf, size_t count);
+};
+
+#define DEVICE_ATTR_RO(_name) \
+	struct device_attribute dev_attr_##_name = { \
+		.attr = { .name = #_name, .mode = 0444 }, \
+		.show = _name##_show }
+#define DEVICE_ATTR_RW(_name) \
+	struct device_attribute dev_attr_##_name = { \
+		.attr = { .name = #_name, .mode = 0644 }, \
+		.show = _name##_show, .store = _name##_store }
+
+struct file;
+struct bin_attribute {
+	struct attribute attr;
+	size_t size;
+	ssize_t (*read) (struct file *filp, struct kobject *kobj, struct bin_attribute *attr,
+		char *buf, loff_t off, size_t count);
+	ssize_t (*write) (struct file *filp, struct kobject *kobj, struct bin_attribute *attr,
+		char *buf, loff_t off, size_t count);
+};
+
+#define BIN_ATTR_RW(_name, _size) \
+	struct bin_attribute bin_attr_##_name = { \
+		.attr = { .name = #_name, .mode = 0644 }, .size = _size, \
+		.read = _name##_read, .write = _name##_write }
+
+extern int device_create_file (struct device *dev, const struct device_attribute *attr);
+extern void device_remove_file (struct device *dev, const struct device_attribute *attr);
+extern int device_create_bin_file (struct device *dev, const struct bin_attribute *attr);
+extern void device_remove_bin_file (struct device *dev, const struct bin_attribute *attr);
+
+/* --- platform devices --- */
+
+typedef struct { int event; } pm_message_t;
+
+struct platform_device {
+	const char *name;
+	struct device dev;
+};
+
+struct of_device_id {
+	char compatible [128];
+};
+
+struct device_driver {
+	const char *name;
+	const struct of_device_id *of_match_table;
+};
+
+struct platform_driver {
+	int (*probe) (struct platform_device *);
+	int (*remove) (struct platform_device *);
+	void (*shutdown) (struct platform_device *);
+	int (*suspend) (struct platform_device *, pm_message_t state);
+	int (*resume) (struct platform_device *);
+	struct device_driver driver;
+};
+
+#define platform_set_drvdata(pdev, data) ((pdev)->dev.driver_data = (data))
+#define platform_get_drvdata(pdev)	((pdev)->dev.driver_data)
+
+extern int platform_driver_register (struct platform_driver *drv);
+extern void platform_driver_unregister (struct platform_driver *drv);
+
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+#define module_init(fn)		int sim_module_init (void) { return fn (); }
+#define subsys_initcall_sync(fn) module_init(fn)
+#define module_exit(fn)		void sim_module_exit (void) { fn (); }
+#define THIS_MODULE		NULL
+
+/* --- device tree --- */
+
+struct property {
+	const char *name;
+	int length;
+	void *value;
+};
+
+struct device_node {
+	struct property *properties;
+	int count;
+};
+
+enum of_gpio_flags { OF_GPIO_ACTIVE_LOW = 1 };
+
+extern struct property *of_find_property (const struct device_node *np, const char *name, int *lenp);
+extern int of_property_count_strings (struct device_node *np, const char *propname);
+extern int of_property_read_string_index (struct device_node *np, const char *propname,
+	int index, const char **output);
+extern int of_property_read_string (struct device_node *np, const char *propname,
+	const char **out_string);
+extern int of_property_read_u32 (const struct device_node *np, const char *propname, u32 *out_value);
+extern int of_get_named_gpio_flags (struct device_node *np, const char *list_name,
+	int index, enum of_gpio_flags *flags);
+
+/* --- firmware: the simulation has none --- */
+
+struct firmware {
+	size_t size;
+	const u8 *data;
+};
+
+#define request_firmware_direct(fw, name, dev)	(*(fw) = NULL, -ENOENT)
+#define release_firmware(fw)
+
+/* --- GPIO, implemented by the simulated bus --- */
+
+extern int gpio_request (unsigned gpio, const char *label);
+extern void gpio_set_value (unsigned gpio, int value);
+extern int gpio_get_value (unsigned gpio);
+extern int gpio_direction_input (unsigned gpio);
+extern int gpio_direction_output (unsigned gpio, int value);
+
+/* descriptor based GPIO, all bus pins are on a chip with set_multiple */
+struct gpio_desc {
+	unsigned gpio;
+};
+
+struct gpio_chip {
+	void (*set_multiple) (struct gpio_chip *chip, unsigned long *mask, unsigned long *bits);
+};
+
+extern struct gpio_desc *gpio_to_desc (unsigned gpio);
+extern struct gpio_chip *gpiod_to_chip (const struct gpio_desc *desc);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,19,0)
+struct gpio_array;
+extern int gpiod_set_raw_array_value (unsigned array_size, struct gpio_desc **desc_array,
+	struct gpio_array *array_info, unsigned long *value_bitmap);
+#else
+extern void gpiod_set_raw_array_value (unsigned array_size, struct gpio_desc **desc_array,
+	int *value_array);
+#endif
+
+/* --- input --- */
+
+#define EV_KEY			0x01
+#define EV_CNT			0x20
+#define KEY_CNT			0x300
+#define BUS_ISA			0x10
+
+struct input_id {
+	u16 bustype, vendor, product, version;
+};
+
+struct input_dev {
+	const char *name;
+	const char *phys;
+	struct input_id id;
+	unsigned long evbit [EV_CNT / (8 * sizeof (long))];
+	unsigned long keybit [KEY_CNT / (8 * sizeof (long))];
+	struct device dev;
+};
+
+extern struct input_dev *input_allocate_device (void);
+extern int input_register_device (struct input_dev *dev);
+extern void input_free_device (struct input_dev *dev);
+extern void input_report_key (struct input_dev *dev, unsigned code, int value);
+extern void input_sync (struct input_dev *dev);
+
+/* --- character devices --- */
+
+typedef int pgprot_t;
+
+struct vm_area_struct;
+
+struct vm_operations_struct {
+	void (*open) (struct vm_area_struct *);
+	void (*close) (struct vm_area_struct *);
+};
+
+struct vm_area_struct {
+	unsigned long vm_start;
+	unsigned long vm_end;
+	unsigned long vm_pgoff;
+	pgprot_t vm_page_prot;
+	const struct vm_operations_struct *vm_ops;
+	void *vm_private_data;
+};
+
+struct inode;
+
+struct file {
+	void *private_data;
+};
+
+struct file_operations {
+	void *owner;
+	int (*open) (struct inode *, struct file *);
+	int (*release) (struct inode *, struct file *);
+	ssize_t (*read) (struct file *, char __user *, size_t, loff_t *);
+	ssize_t (*write) (struct file *, const char __user *, size_t, loff_t *);
+	long (*unlocked_ioctl) (struct file *, unsigned int, unsigned long);
+	int (*mmap) (struct file *, struct vm_area_struct *);
+	loff_t (*llseek) (struct file *, loff_t, int);
+};
+
+extern loff_t noop_llseek (struct file *file, loff_t offset, int whence);
+extern loff_t default_llseek (struct file *file, loff_t offset, int whence);
+extern int remap_pfn_range (struct vm_area_struct *vma, unsigned long addr,
+	unsigned long pfn, unsigned long size, pgprot_t prot);
+
+#define MISC_DYNAMIC_MINOR	255
+
+struct miscdevice {
+	int minor;
+	const char *name;
+	const struct file_operations *fops;
+	struct device *parent;
+};
+
+extern int misc_register (struct miscdevice *misc);
+extern int misc_deregister (struct miscdevice *misc);
+
+#endif /* __SIM_KERNEL_H__ */
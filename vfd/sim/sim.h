@@ -0,0 +1,82 @@
+/*
+ * The simulation environment for the VFD driver: fake GPIO bus with a
+ * PT6964 protocol decoder, plus hooks to drive the driver from userspace.
+ * Copyright (c) 2017 Andrew Zabolotny <zapparello@ya.ru>
+ */
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include "sim-kernel.h"
+
+/* GPIO numbers used for the bus signals */
+#define SIM_GPIO_STB		10
+#define SIM_GPIO_CLK		11
+#define SIM_GPIO_DIDO		12
+
+/* bus activity counters */
+struct sim_bus_stats_t {
+	/* bytes transferred in either direction */
+	u64 bytes;
+	/* commands (first byte after STB goes low) */
+	u64 commands;
+	/* calls to gpio_set_value, gpiod_set_raw_array_value & gpio_direction_xxx */
+	u64 gpio_writes;
+	/* calls to gpio_get_value */
+	u64 gpio_reads;
+	/* protocol violations detected by the decoder */
+	u64 errors;
+};
+
+/* the state of the simulated PT6964 chip */
+struct sim_chip_t {
+	/* display RAM */
+	u8 ram [16];
+	/* last display mode command */
+	u8 display_mode;
+	/* display enabled and brightness from the display control command */
+	u8 display_on;
+	u8 brightness;
+	/* key matrix state, in the driver's key bitmap order */
+	u32 keys;
+};
+
+extern struct sim_bus_stats_t sim_bus;
+extern struct sim_chip_t sim_chip;
+
+/* CPU time spent in the driver (sysfs handlers and works), ns */
+extern u64 sim_cpu_ns;
+/* number of input key events reported */
+extern u64 sim_key_events;
+
+/* the simulated platform device */
+extern struct platform_device sim_pdev;
+
+/* set up the device tree of sim_pdev */
+extern void sim_set_properties (struct property *props, int count);
+
+/* the module init & exit functions from vfd.c */
+extern int sim_module_init (void);
+extern void sim_module_exit (void);
+
+/* call the driver's suspend & resume methods */
+extern int sim_suspend (void);
+extern int sim_resume (void);
+
+/* advance time by given number of ms, running works as they expire */
+extern void sim_advance (unsigned ms);
+
+/* sysfs access to the device, returns what the handler returned */
+extern ssize_t sim_attr_store (const char *name, const char *value);
+extern ssize_t sim_attr_show (const char *name, char *buf);
+extern ssize_t sim_bin_write (const char *name, const void *data, size_t size);
+
+/* the /dev/vfd device, NULL if not registered */
+extern struct miscdevice *sim_misc;
+
+/* start measuring the CPU time spent in the driver */
+extern void sim_cpu_begin (void);
+/* stop measuring & add the time to sim_cpu_ns */
+extern void sim_cpu_end (void);
+
+#endif /* __SIM_H__ */
@@ -0,0 +1,527 @@
+/*
+ * Benchmark for the VFD driver core running on the simulated bus.
+ * Copyright (c) 2017 Andrew Zabolotny <zapparello@ya.ru>
+ *
+ * Loads the driver against a fake device tree, then runs a few typical
+ * display update patterns through the driver's userspace interfaces and
+ * reports, per frame, how many bytes went over the bus, how many GPIO
+ * writes were needed, how much delay time the bus protocol demanded and
+ * how much CPU time the driver spent. After every pattern the display
+ * RAM decoded from the bus is checked against what the driver thinks
+ * is on the display. Finally key scanning, blinking, animation and
+ * scrolling done by the driver itself, and the suspend frame are checked.
+ */
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "sim.h"
+#include "../vfd-priv.h"
+
+/* default number of frames per pattern */
+#define DEFAULT_FRAMES		1000
+
+/* a DT property with a big-endian cell array */
+#define PROP(n, v)		{ .name = n, .length = sizeof (v), .value = (void *)v }
+
+static const u8 key_codes [] = {
+	/* scancode 2 -> KEY_POWER, scancode 0 -> KEY_ENTER */
+	0, 2, 0, 116,
+	0, 0, 0, 28,
+};
+
+#if defined COMPAT_FD620
+static const char dot_names [] = "NET\0WIFI\0PLAY\0II\0:\0CLOCK\0USB";
+static const u8 dot_bits [] = { 4, 0, 4, 1, 4, 2, 4, 3, 4, 4, 4, 5, 4, 6 };
+/* the colon LED */
+#define COLON_WORD		4
+#define COLON_BIT		4
+#else
+static const char dot_names [] = "APPS\0SETUP\0USB\0CARD\0:\0HDMI\0CVBS";
+static const u8 dot_bits [] = { 0, 3, 1, 3, 2, 3, 3, 3, 4, 3, 5, 3, 6, 3 };
+#define COLON_WORD		4
+#define COLON_BIT		3
+#endif
+
+static struct property props [] = {
+	PROP ("key_codes", key_codes),
+	PROP ("dot_names", dot_names),
+	PROP ("dot_bits", dot_bits),
+};
+
+static struct vfd_t *vfd;
+static int frames = DEFAULT_FRAMES;
+
+struct pattern_t {
+	const char *name;
+	const char *descr;
+	/* produce frame n */
+	void (*frame) (int n);
+};
+
+//***//***//***//***//***//***// patterns //***//***//***//***//***//***//
+
+/* write a frame through the frame attribute */
+static void put_frame (u8 flags, const char *text, u16 colon, int brightness)
+{
+	struct vfd_frame_t frame;
+
+	memset (&frame, 0, sizeof (frame));
+	frame.flags = flags;
+	strncpy (frame.text, text, sizeof (frame.text));
+	frame.overlay [COLON_WORD] = colon;
+	frame.brightness = brightness;
+	sim_bin_write ("frame", &frame, sizeof (frame));
+}
+
+static void clock_text (int n, char *buf)
+{
+	/* one "minute" is 120 half-second frames */
+	int min = n / 120;
+	sprintf (buf, "%02d%02d", (min / 60) % 24, min % 60);
+}
+
+static u16 clock_colon (int n)
+{
+	return (n & 1) ? 0 : (1 << COLON_BIT);
+}
+
+static void frame_counter (int n)
+{
+	char buf [8];
+	sprintf (buf, "%04d", n % 10000);
+	sim_attr_store ("display", buf);
+}
+
+static void frame_same_text (int n)
+{
+	sim_attr_store ("display", "1234");
+}
+
+static void frame_overlay (int n)
+{
+	char buf [64];
+	int i, len = 0;
+
+	for (i = 0; i < RAW_DISPLAY_WORDS; i++)
+		len += sprintf (buf + len, "%04x ", (i == COLON_WORD) ? clock_colon (n) : 0);
+	sim_attr_store ("overlay", buf);
+}
+
+static void frame_dotled (int n)
+{
+	sim_attr_store ("dotled", (n & 1) ? ": 0" : ": 1");
+}
+
+static void frame_clock_attrs (int n)
+{
+	char buf [8];
+
+	clock_text (n, buf);
+	sim_attr_store ("display", buf);
+	frame_overlay (n);
+}
+
+static void frame_clock_frame (int n)
+{
+	char buf [8];
+
+	clock_text (n, buf);
+	put_frame (VFD_FRAME_TEXT | VFD_FRAME_OVERLAY, buf, clock_colon (n), 0);
+}
+
+static void frame_clock_mmap (int n)
+{
+	struct file file = { .private_data = sim_misc };
+	struct vfd_frame_t *frame = vfd->shared_frame;
+
+	frame->flags = VFD_FRAME_TEXT | VFD_FRAME_OVERLAY;
+	clock_text (n, frame->text);
+	frame->overlay [COLON_WORD] = clock_colon (n);
+
+	sim_cpu_begin ();
+	sim_misc->fops->unlocked_ioctl (&file, VFD_IOC_FLUSH, 0);
+	sim_cpu_end ();
+}
+
+static void frame_brightness (int n)
+{
+	sim_attr_store ("brightness", (n & 1) ? "2" : "5");
+}
+
+static void frame_burst (int n)
+{
+	int i;
+	char buf [8];
+
+	/* many writes per frame, only the last one should hit the bus */
+	for (i = 0; i < 10; i++) {
+		sprintf (buf, "%04d", (n * 10 + i) % 10000);
+		sim_attr_store ("display", buf);
+	}
+}
+
+static const struct pattern_t patterns [] = {
+	{ "counter", "text changes every frame", frame_counter },
+	{ "same", "the same text written every frame", frame_same_text },
+	{ "overlay", "colon blinks via overlay", frame_overlay },
+	{ "dotled", "colon blinks via dotled", frame_dotled },
+	{ "clock", "clock via display+overlay", frame_clock_attrs },
+	{ "clock-frame", "clock via frame attribute", frame_clock_frame },
+	{ "clock-mmap", "clock via /dev/vfd mmap+flush", frame_clock_mmap },
+	{ "brightness", "brightness changes every frame", frame_brightness },
+	{ "burst", "10 text writes per frame", frame_burst },
+};
+
+//***//***//***//***//***//***// benchmark //***//***//***//***//***//***//
+
+/* compare the display RAM decoded from the bus with the driver's idea of it */
+static int check_ram (void)
+{
+	int i;
+
+	for (i = 0; i < RAW_DISPLAY_WORDS; i++) {
+		u16 ram = sim_chip.ram [i * 2] | (sim_chip.ram [i * 2 + 1] << 8);
+		if (ram != vfd->raw_display [i]) {
+			printf ("  RAM mismatch at word %d: bus %04x, driver %04x\n",
+				i, ram, vfd->raw_display [i]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int run_pattern (const struct pattern_t *p)
+{
+	int n;
+	struct sim_bus_stats_t start = sim_bus;
+	u64 delay_start = sim_delay_ns;
+	u64 cpu_start = sim_cpu_ns;
+	unsigned long wakeups_start = vfd->flush_wakeups + vfd->scan_wakeups;
+	double f;
+
+	for (n = 0; n < frames; n++) {
+		p->frame (n);
+		/* let the flush work run; frames are spaced by more than the rate limit */
+		sim_advance (VFD_FLUSH_INTERVAL + 5);
+	}
+
+	f = frames;
+	printf ("%-12s %8.1f %8.1f %8.2f %8.2f %8.2f   %s\n", p->name,
+		(sim_bus.bytes - start.bytes) / f,
+		(sim_bus.gpio_writes - start.gpio_writes) / f,
+		(sim_delay_ns - delay_start) / f / 1000.0,
+		(sim_cpu_ns - cpu_start) / f / 1000.0,
+		(vfd->flush_wakeups + vfd->scan_wakeups - wakeups_start) / f,
+		p->descr);
+
+	if (sim_bus.errors != start.errors) {
+		printf ("  %llu bus protocol errors\n",
+			(unsigned long long)(sim_bus.errors - start.errors));
+		return -1;
+	}
+
+	return check_ram ();
+}
+
+/* check key scanning and idle wakeups */
+static int run_keys (void)
+{
+	unsigned long scans;
+	u64 events = sim_key_events;
+
+	/* idle: no keys pressed */
+	scans = vfd->scan_wakeups;
+	sim_advance (10000);
+	printf ("idle key scans: %.1f/s\n", (vfd->scan_wakeups - scans) / 10.0);
+
+	/* hold scancode 2 for a second */
+	sim_chip.keys = 1 << 2;
+	sim_advance (VFD_SCAN_IDLE);
+	scans = vfd->scan_wakeups;
+	sim_advance (1000);
+	printf ("key held scans: %lu/s\n", vfd->scan_wakeups - scans);
+	sim_chip.keys = 0;
+	sim_advance (VFD_SCAN_IDLE);
+
+	if (sim_key_events - events != 2) {
+		printf ("  expected 2 key events, got %llu\n",
+			(unsigned long long)(sim_key_events - events));
+		return -1;
+	}
+
+	if (vfd->last_scancode != 2) {
+		printf ("  expected scancode 2, got %u\n", vfd->last_scancode);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* check that the driver blinks the colon by itself, in sync with the wall clock */
+static int run_blink (void)
+{
+	int i, errors = 0;
+	unsigned long flushes;
+	u16 colon = 1 << COLON_BIT;
+
+	sim_attr_store ("display", "1234");
+	sim_attr_store ("dotled", ": 1");
+	sim_attr_store ("blink", ": 1000 500 0");
+
+	/* sample in the middle of every lit and dark half-second */
+	sim_advance (1000 - (jiffies % 1000) + 125);
+	flushes = vfd->flush_wakeups;
+
+	for (i = 0; i < 40; i++) {
+		u16 ram = sim_chip.ram [COLON_WORD * 2] | (sim_chip.ram [COLON_WORD * 2 + 1] << 8);
+		int lit = (jiffies % 1000) < 500;
+
+		if (((ram & colon) != 0) != lit) {
+			printf ("  colon is %s at %lu ms\n", lit ? "dark" : "lit", jiffies % 1000);
+			errors++;
+		}
+		sim_advance (250);
+	}
+	printf ("blink flushes: %.1f/s\n", (vfd->flush_wakeups - flushes) / 10.0);
+
+	/* display writes don't wait for the next blink state change */
+	sim_attr_store ("display", "5678");
+	sim_advance (VFD_FLUSH_INTERVAL + 5);
+	if ((memcmp (vfd->shadow_display, "5678", 4) != 0) || (check_ram () != 0)) {
+		printf ("  display write delayed while blinking\n");
+		errors++;
+	}
+
+	/* once blinking stops, so do the wakeups (after the one already queued) */
+	sim_attr_store ("blink", ": 0 0 0");
+	sim_advance (1000);
+	flushes = vfd->flush_wakeups;
+	sim_advance (10000);
+	if (vfd->flush_wakeups != flushes) {
+		printf ("  %lu flushes after blinking stopped\n", vfd->flush_wakeups - flushes);
+		errors++;
+	}
+
+	return errors ? -1 : 0;
+}
+
+/* check that an uploaded animation is played by the driver without userspace help */
+static int run_anim (void)
+{
+	struct vfd_anim_step_t steps [2];
+	unsigned long scans;
+	int i, errors = 0;
+
+	memset (steps, 0, sizeof (steps));
+	for (i = 0; i < 2; i++) {
+		steps [i].duration = 500;
+		steps [i].frame.flags = VFD_FRAME_TEXT;
+		strcpy (steps [i].frame.text, i ? "5678" : "1234");
+	}
+	steps [1].flags = VFD_ANIM_LOOP;
+
+	scans = vfd->scan_wakeups;
+	sim_bin_write ("anim", steps, sizeof (steps));
+
+	/* sample in the middle of every half of a step */
+	sim_advance (125);
+	for (i = 0; i < 20; i++) {
+		if (memcmp (vfd->display, steps [i / 2 % 2].frame.text, 4) != 0) {
+			printf ("  animation shows '%.4s' at step %d\n", vfd->display, i / 2);
+			errors++;
+		}
+		sim_advance (250);
+	}
+	printf ("anim scans: %.1f/s\n", (vfd->scan_wakeups - scans) / 5.125);
+
+	/* userspace text stops the animation */
+	sim_attr_store ("display", "0000");
+	sim_advance (1000);
+	if (memcmp (vfd->display, "0000", 4) != 0) {
+		printf ("  animation still running after a text write\n");
+		errors++;
+	}
+
+	return errors ? -1 : 0;
+}
+
+/* check that a long string is scrolled by the driver */
+static int run_scroll (void)
+{
+	static const char text [] = "HELLO";
+	/* the string followed by as many spaces as there are digits, cyclic */
+	static const char cycle [] = "HELLO    HELLO    HELLO";
+	int i, errors = 0;
+
+	sim_attr_store ("display", text);
+	for (i = 0; i < 12; i++) {
+		if (memcmp (vfd->display, cycle + i % 9, 4) != 0) {
+			printf ("  scroll shows '%.4s' at step %d\n", vfd->display, i);
+			errors++;
+		}
+		sim_advance (VFD_SCROLL_STEP);
+	}
+
+	sim_attr_store ("display", "1234");
+	sim_advance (VFD_FLUSH_INTERVAL + 5);
+
+	return (errors || check_ram ()) ? -1 : 0;
+}
+
+/* check that the driver shows the preloaded suspend frame by itself */
+static int run_suspend (void)
+{
+	struct vfd_frame_t frame;
+	u8 ram [sizeof (sim_chip.ram)];
+	char live [RAW_DISPLAY_WORDS];
+	unsigned long wakeups;
+	int errors = 0;
+
+	memset (&frame, 0, sizeof (frame));
+	frame.flags = VFD_FRAME_TEXT | VFD_FRAME_OVERLAY | VFD_FRAME_BRIGHTNESS;
+	strcpy (frame.text, "*  *");
+	frame.overlay [COLON_WORD] = 1 << COLON_BIT;
+	frame.brightness = 1;
+	sim_bin_write ("suspend_frame", &frame, sizeof (frame));
+
+	/* something that would overwrite the frame if the driver let it */
+	sim_attr_store ("display", "HELLO");
+	sim_attr_store ("blink", ": 1000 500 0");
+	sim_advance (1000);
+
+	memcpy (live, vfd->display, sizeof (live));
+	sim_suspend ();
+	memcpy (ram, sim_chip.ram, sizeof (ram));
+	wakeups = vfd->flush_wakeups + vfd->scan_wakeups;
+	sim_advance (5000);
+
+	if ((vfd->flush_wakeups + vfd->scan_wakeups != wakeups) ||
+	    (memcmp (ram, sim_chip.ram, sizeof (ram)) != 0)) {
+		printf ("  display changed while suspended\n");
+		errors++;
+	}
+	if (!(ram [COLON_WORD * 2] & (1 << COLON_BIT)) || (sim_chip.brightness != 0)) {
+		printf ("  suspend frame not shown\n");
+		errors++;
+	}
+	if (memcmp (vfd->display, live, sizeof (live)) != 0) {
+		printf ("  live text changed while suspended: '%.4s'\n", vfd->display);
+		errors++;
+	}
+	if (vfd->brightness_suspend != 0) {
+		printf ("  suspend frame changed brightness_suspend to %d\n", vfd->brightness_suspend);
+		errors++;
+	}
+
+	/* the live text is back and keeps scrolling (the step overdue since
+	 * suspend is done right away) */
+	sim_resume ();
+	sim_advance (VFD_FLUSH_INTERVAL + 5);
+	if (check_ram () != 0)
+		errors++;
+	if (memcmp (vfd->display, live + 1, 3) != 0) {
+		printf ("  not scrolling after resume: '%.4s'\n", vfd->display);
+		errors++;
+	}
+
+	sim_attr_store ("blink", ": 0 0 0");
+	sim_attr_store ("display", "1234");
+	sim_advance (1000);
+
+	return errors ? -1 : 0;
+}
+
+/* check that /dev/vfd reads as a single frame */
+static int run_cdev_read (struct file *file)
+{
+	struct vfd_frame_t frame;
+	loff_t pos = 0;
+	int errors = 0;
+
+	if (sim_misc->fops->read (file, (char *)&frame, sizeof (frame), &pos) != sizeof (frame)) {
+		printf ("  /dev/vfd read failed\n");
+		errors++;
+	}
+	if (sim_misc->fops->read (file, (char *)&frame, sizeof (frame), &pos) != 0) {
+		printf ("  /dev/vfd read past the frame\n");
+		errors++;
+	}
+
+	return errors ? -1 : 0;
+}
+
+int main (int argc, char **argv)
+{
+	int i, ret = 0;
+	struct file file;
+	const struct file_operations *fops;
+	struct vfd_frame_t frame;
+	loff_t pos = 0;
+
+	while ((i = getopt (argc, argv, "n:v")) != -1)
+		switch (i) {
+			case 'n':
+				frames = atoi (optarg);
+				break;
+
+			case 'v':
+				sim_verbose = 1;
+				break;
+
+			default:
+				fprintf (stderr, "Usage: %s [-n frames] [-v]\n", argv [0]);
+				return 1;
+		}
+
+	sim_set_properties (props, ARRAY_SIZE (props));
+	if (sim_module_init () != 0) {
+		fprintf (stderr, "driver probe failed\n");
+		return 1;
+	}
+
+	vfd = platform_get_drvdata (&sim_pdev);
+	printf ("bus delay %d ns, strobe delay %d ns\n", vfd->bus_delay_ns, vfd->stb_delay_ns);
+
+	/* let the boot animation finish */
+	sim_advance (1000);
+
+	printf ("%-12s %8s %8s %8s %8s %8s\n", "pattern", "bytes", "gpio", "delay,us", "cpu,us", "wakeups");
+	for (i = 0; i < ARRAY_SIZE (patterns); i++)
+		if (run_pattern (&patterns [i]) != 0)
+			ret = 1;
+
+	if (run_keys () != 0)
+		ret = 1;
+
+	if (run_blink () != 0)
+		ret = 1;
+
+	if (run_anim () != 0)
+		ret = 1;
+
+	if (run_scroll () != 0)
+		ret = 1;
+
+	if (run_suspend () != 0)
+		ret = 1;
+
+	/* a file still open on removal must keep working, returning errors */
+	file.private_data = sim_misc;
+	fops = sim_misc->fops;
+	fops->open (NULL, &file);
+	if (run_cdev_read (&file) != 0)
+		ret = 1;
+
+	sim_module_exit ();
+
+	if (fops->read (&file, (char *)&frame, sizeof (frame), &pos) != -ENODEV) {
+		printf ("  /dev/vfd still readable after removal\n");
+		ret = 1;
+	}
+	fops->release (NULL, &file);
+
+	printf ("%s\n", ret ? "FAILED" : "ok");
+	return ret;
+}
@@ -13,9 +13,9 @@
 #include "vfd-priv.h"
 
 struct vfd_glyph_render_t {
-	const u8 *cellno;
-	const u8 *cellbit;
-	u8 bitmap ['~' - ' ' + 1];
+	/* the raw display words lit by every character at every display
+	 * position, so that rendering is just OR'ing them together */
+	u16 lut [RAW_DISPLAY_WORDS]['~' - ' ' + 1][RAW_DISPLAY_WORDS];
 };
 
 /* Convert a string of 8-bit characters into a string of 16-bit
@@ -28,35 +28,36 @@ static void vfd_display_to_raw_ca (struct vfd_t *vfd, u8 *display, u16 *raw)
 	memset (raw, 0, sizeof (vfd->raw_display));
 
 	for (i = 0; i < vfd->display_len; i++) {
-		u16 bit;
-		u8 bitmap, ch = display [i] - ' ';
-		if (ch >= ARRAY_SIZE (g->bitmap))
+		const u16 *cell;
+		u8 ch = display [i] - ' ';
+		if (ch >= ARRAY_SIZE (g->lut [0]))
 			ch = 0;
-		bitmap = g->bitmap [ch];
 
-		// stuff bits a-g to respective slots in respective display cells...
-		bit = (1U << g->cellbit [i]);
-		for (j = 0; j < 7; j++)
-			if (bitmap & (1 << j))
-				raw [g->cellno [j]] |= bit;
+		cell = g->lut [i][ch];
+		for (j = 0; j < RAW_DISPLAY_WORDS; j++)
+			raw [j] |= cell [j];
 	}
 }
 
 void vfd_init_glyphs_ca (struct vfd_t *vfd, const u8 *cellno, const u8 *cellbit)
 {
-	unsigned i;
+	unsigned i, j, pos;
 	u8 code;
 	struct vfd_glyph_render_t *g = kzalloc (sizeof (struct vfd_glyph_render_t), GFP_KERNEL);
 	vfd->display_to_raw = vfd_display_to_raw_ca;
 	vfd->glyph_render_data = g;
-	g->cellno = cellno;
-	g->cellbit = cellbit;
 
 	for (i = 0; (code = vfd_glyphs [i].code) != 0; i++) {
+		u8 bitmap = vfd_glyphs [i].image;
+
 		code -= ' ';
-		if (code >= ARRAY_SIZE (g->bitmap))
+		if (code >= ARRAY_SIZE (g->lut [0]))
 			continue;
 
-		g->bitmap [code] = vfd_glyphs [i].image;
+		// stuff bits a-g to respective slots in respective display cells...
+		for (pos = 0; pos < vfd->display_len; pos++)
+			for (j = 0; j < 7; j++)
+				if (bitmap & (1 << j))
+					g->lut [pos][code][cellno [j]] |= (1U << cellbit [pos]);
 	}
 }
@@ -0,0 +1,79 @@
+/*
+ * Userspace interface to the /dev/vfd character device
+ * Copyright (c) 2017 Andrew Zabolotny <zapparello@ya.ru>
+ *
+ * Writing a struct vfd_frame_t to /dev/vfd updates the display the same
+ * way as writing it to the "frame" sysfs attribute. Reading returns the
+ * current state. For high-rate producers the device also can be mmap'ed:
+ * the first bytes of the page hold a struct vfd_frame_t which userspace
+ * fills in place and then applies with the VFD_IOC_FLUSH ioctl.
+ *
+ * Animations (arrays of struct vfd_anim_step_t) are uploaded through the
+ * "anim" sysfs attribute and played by the driver itself.
+ */
+
+#ifndef __VFD_IOCTL_H__
+#define __VFD_IOCTL_H__
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* max number of glyphs and overlay words in a frame */
+#define VFD_FRAME_WORDS			8
+
+/* bits in vfd_frame_t.flags telling which fields are valid */
+#define VFD_FRAME_TEXT			0x01
+#define VFD_FRAME_OVERLAY		0x02
+#define VFD_FRAME_BRIGHTNESS		0x04
+
+/*
+ * The binary frame layout. Writing a frame updates all the fields marked
+ * in flags at once, with a single display update. Reading returns the
+ * current state with all flags set.
+ */
+struct vfd_frame_t {
+	/* a combination of VFD_FRAME_XXX bits */
+	__u8 flags;
+	/* display brightness, 0..brightness_max */
+	__u8 brightness;
+	/* displayed characters, zero-padded; text longer than the display scrolls */
+	char text [VFD_FRAME_WORDS];
+	/* raw overlay words, same as in the "overlay" attribute */
+	__u16 overlay [VFD_FRAME_WORDS];
+};
+
+/* max number of steps in an animation */
+#define VFD_ANIM_STEPS			64
+
+/* bits in vfd_anim_step_t.flags */
+/* after this step, continue from the first one */
+#define VFD_ANIM_LOOP			0x0001
+
+/*
+ * One step of an animation. Every frame is applied the same way as a
+ * write to the "frame" attribute, then stays for the given duration.
+ * Without a loop, the last frame stays on display when the animation
+ * ends. An animation consisting of a single step with zero duration
+ * just stops the current one, and so does writing any text to the
+ * display from userspace.
+ */
+struct vfd_anim_step_t {
+	/* how long to show this frame, ms */
+	__u16 duration;
+	/* a combination of VFD_ANIM_XXX bits */
+	__u16 flags;
+	struct vfd_frame_t frame;
+};
+
+#define VFD_IOC_MAGIC			'V'
+
+/* Set display brightness (0..brightness_max) */
+#define VFD_IOC_SET_BRIGHTNESS		_IOW(VFD_IOC_MAGIC, 1, int)
+/* Enable (1) or disable (0) the display */
+#define VFD_IOC_SET_ENABLE		_IOW(VFD_IOC_MAGIC, 2, int)
+/* Apply the frame from the mmap'ed page */
+#define VFD_IOC_FLUSH			_IO(VFD_IOC_MAGIC, 3)
+/* Get the current display state */
+#define VFD_IOC_GET_FRAME		_IOR(VFD_IOC_MAGIC, 4, struct vfd_frame_t)
+
+#endif /* __VFD_IOCTL_H__ */
@@ -5,21 +5,19 @@
 #ifndef __VFD_PRIV_H__
 #define __VFD_PRIV_H__
 
-#include <linux/timer.h>
+#include <linux/kref.h>
 #include <linux/mutex.h>
+#include <linux/seqlock.h>
 #include <linux/delay.h>
+#include <linux/miscdevice.h>
+#include <linux/workqueue.h>
+
+#include "vfd-ioctl.h"
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
 #include <linux/earlysuspend.h>
 #endif
 
-#ifdef CONFIG_VFD_NO_DELAYS
-#undef udelay
-#undef ndelay
-#define udelay(x)
-#define ndelay(x)
-#endif
-
 //#define VFD_DEBUG
 #ifdef VFD_DEBUG
 #define DBG_PRINT(msg,...)	printk ("%s:%d (%s): " msg, __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
@@ -43,6 +41,29 @@
 #define RAW_DISPLAY_WORDS		7
 #endif
 
+/* Boot animation step, ms */
+#define VFD_BOOT_ANIM_STEP		100
+/* Key scan period while no keys are pressed, ms; the PT6964 doesn't latch
+ * key presses between reads, so a longer period would lose short presses */
+#define VFD_SCAN_IDLE			100
+/* Key scan period while any key is held down, ms */
+#define VFD_SCAN_FAST			50
+/* Minimal interval between two on-demand display flushes, ms */
+#define VFD_FLUSH_INTERVAL		20
+/* Longest string accepted by the "display" attribute, the rest is cut off */
+#define VFD_SCROLL_MAX			64
+/* Scroll step for strings longer than the display, ms */
+#define VFD_SCROLL_STEP			300
+
+/* bit numbers in vfd_t.need_update */
+enum
+{
+	// display or overlay changed
+	VFD_NEED_DISPLAY,
+	// brightness or enable changed
+	VFD_NEED_BRIGHTNESS,
+};
+
 struct vfd_key_t {
 	/* linux key code */
 	u16 keycode;
@@ -50,6 +71,15 @@ struct vfd_key_t {
 	u16 scancode;
 };
 
+struct vfd_blink_t {
+	/* blink period, ms; 0 if not blinking */
+	u16 period;
+	/* the time the element is lit within every period, ms */
+	u16 duty;
+	/* period start offset relative to the realtime clock, ms */
+	u16 phase;
+};
+
 struct vfd_dotled_t {
 	/* LED name */
 	const char *name;
@@ -57,6 +87,8 @@ struct vfd_dotled_t {
 	u16 word;
 	/* bit number within the word */
 	u16 bit;
+	/* LED blinking, protected by state_lock */
+	struct vfd_blink_t blink;
 };
 
 enum
@@ -73,16 +105,60 @@ enum
 };
 
 struct vfd_t {
-	/* the global device lock */
+	/* serializes access to the bus */
 	struct mutex lock;
+	/*
+	 * Protects the logical display state (display, raw_overlay, brightness,
+	 * enabled) against concurrent writers. Writers never wait for the bus:
+	 * the flusher takes a consistent snapshot into shadow_display and
+	 * shadow_overlay without blocking them, and writes to the bus from there.
+	 */
+	seqlock_t state_lock;
 
 	struct input_dev *input;
-	struct timer_list timer;
+	/* the workqueue doing all the bus I/O in process context */
+	struct workqueue_struct *wq;
+	/* key scan, animation and scrolling, only queued while there's something to do */
+	struct delayed_work scan_work;
+	/* number of scan_work and flush_work runs, to check idle behaviour */
+	unsigned long scan_wakeups;
+	unsigned long flush_wakeups;
+	/* pushes display changes to the chip as soon as possible,
+	 * and on every blink state change while anything blinks */
+	struct delayed_work flush_work;
+	/* jiffies of the last on-demand flush, for rate limiting */
+	unsigned long last_flush;
+	/* jiffies when flush_work re-evaluates blinking, 0 if not waiting for it */
+	unsigned long blink_due;
+
+	/* the /dev/vfd character device */
+	struct miscdevice misc;
+	/* held by the platform device and by every open /dev/vfd,
+	 * the last put frees the structure and the shared page */
+	struct kref ref;
+	/* serializes /dev/vfd calls against device removal */
+	struct mutex cdev_lock;
+	/* 1 once the device is gone, /dev/vfd calls fail with -ENODEV */
+	int cdev_dead;
+	/* the page shared with userspace via mmap() */
+	struct vfd_frame_t *shared_frame;
 
 	/* bus gpio numbers */
 	int gpio [GPIO_MAX];
 	/* 1 if DI/DO pin is in output mode */
 	int dido_gpio_out;
+	/* last data setting command sent to the chip, 0 if unknown */
+	u8 data_cmd;
+	/* last display control command sent to the chip, 0 if unknown */
+	u8 last_ctrl;
+	/* extra delay after every CLK edge, ns; -1 to calibrate at init */
+	int bus_delay_ns;
+	/* extra delay after STB goes high, ns; -1 to calibrate at init */
+	int stb_delay_ns;
+	/* bus gpio descriptors, for the batched output path */
+	struct gpio_desc *gpiod [GPIO_MAX];
+	/* 1 if CLK and DI/DO can be set with a single gpiod array call */
+	int gpiod_array;
 
 	/* number of keys defined in DTS */
 	int num_keys;
@@ -99,8 +175,22 @@ struct vfd_t {
 	char display[RAW_DISPLAY_WORDS];
 	/* the raw overlay data for additional bits to be set (extra LEDs) */
 	u16 raw_overlay [RAW_DISPLAY_WORDS];
+	/* the snapshot of display being written to the chip */
+	char shadow_display [RAW_DISPLAY_WORDS];
+	/* the snapshot of raw_overlay being written to the chip */
+	u16 shadow_overlay [RAW_DISPLAY_WORDS];
 	/* The raw display content (device-dependent format) */
 	u16 raw_display [RAW_DISPLAY_WORDS];
+	/* the text last rendered by display_to_raw */
+	char raw_text_display [RAW_DISPLAY_WORDS];
+	/* the rendering of raw_text_display, without overlay */
+	u16 raw_text [RAW_DISPLAY_WORDS];
+	/* 1 if raw_text matches raw_text_display */
+	u8 raw_text_valid;
+	/* digit blinking, protected by state_lock */
+	struct vfd_blink_t digit_blink [RAW_DISPLAY_WORDS];
+	/* number of digits and dot LEDs currently blinking */
+	int blinking;
 
 	/*
 	 * Convert a string of 8-bit characters into a string of 16-bit display bitmasks
@@ -121,16 +211,41 @@ struct vfd_t {
 	u8 brightness_max;
 	/* Brightness in suspend mode */
 	u8 brightness_suspend;
+	/* Brightness actually used while suspended: the one of the shown
+	 * suspend or shutdown frame, or brightness_suspend */
+	u8 brightness_frame;
 	/* Display enabled (1) or disabled (0) */
 	u8 enabled;
 	/* Operating system suspended (1) or resumed (0) */
 	u8 suspended;
-	/* Set to 1 if any variables affecting display have changed */
-	u8 need_update;
-	/* Boot animation stage */
-	u8 boot_anim;
+	/* frames shown by the driver itself on suspend & shutdown, protected
+	 * by state_lock; ignored if flags are 0 */
+	struct vfd_frame_t suspend_frame;
+	struct vfd_frame_t shutdown_frame;
+	/* VFD_NEED_XXX bits for things that have to be written to the chip */
+	unsigned long need_update;
 	/* the state of up to 20 keys */
 	u32 keystate;
+	/* jiffies when the next key scan is due */
+	unsigned long keys_due;
+
+	/* the animation being played, protected by state_lock */
+	struct vfd_anim_step_t *anim;
+	/* number of steps in anim, 0 if no animation is playing */
+	int anim_len;
+	/* the next step to show */
+	int anim_pos;
+	/* jiffies when the next step is due */
+	unsigned long anim_due;
+
+	/* the string being scrolled, protected by state_lock */
+	char scroll [VFD_SCROLL_MAX];
+	/* scrolled string length, 0 if not scrolling */
+	int scroll_len;
+	/* the position of the first visible character */
+	int scroll_pos;
+	/* jiffies when the next scroll step is due */
+	unsigned long scroll_due;
 
 	/* number of elements in the dotleds array */
 	int num_dotleds;
@@ -185,7 +300,8 @@ extern void hardware_update_brightness(struct vfd_t *vfd);
 extern void hardware_suspend(struct vfd_t *vfd, int enable);
 
 /*
- * Update display cells that were changed.
+ * Update display cells that were changed, from shadow_display and shadow_overlay.
+ * Called with the bus lock held.
  * @param vfd
  *      the platform device structure
  */
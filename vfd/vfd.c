@@ -40,6 +40,11 @@
 
 #include <linux/major.h>
 #include <linux/slab.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/firmware.h>
 #include <asm/uaccess.h>
 
 #include "vfd-priv.h"
@@ -70,8 +75,41 @@ static ssize_t display_show(struct device *dev,
 	struct device_attribute *attr, char *buf)
 {
 	struct vfd_t *vfd = dev_get_drvdata(dev);
-	memcpy (buf, vfd->display, vfd->display_len);
-	return vfd->display_len;
+	unsigned seq;
+	ssize_t len;
+
+	do {
+		seq = read_seqbegin(&vfd->state_lock);
+		/* a scrolled string is shown whole */
+		if ((len = vfd->scroll_len) != 0)
+			memcpy (buf, vfd->scroll, len);
+		else {
+			len = vfd->display_len;
+			memcpy (buf, vfd->display, len);
+		}
+	} while (read_seqretry(&vfd->state_lock, seq));
+
+	return len;
+}
+
+/*
+ * Mark something (one of VFD_NEED_XXX) dirty and schedule a flush.
+ * Flushes are at least VFD_FLUSH_INTERVAL ms apart, so a burst of writes
+ * ends up in a single bus transaction. Pending work is not re-queued,
+ * thus all changes made until the work runs are merged; the exception
+ * is a flush waiting for the next blink state change, which is pulled in.
+ */
+static void _need_update(struct vfd_t *vfd, int what)
+{
+	unsigned long next = vfd->last_flush + msecs_to_jiffies(VFD_FLUSH_INTERVAL);
+	unsigned long delay = time_before(jiffies, next) ? next - jiffies : 0;
+	unsigned long blink_due = vfd->blink_due;
+
+	set_bit(what, &vfd->need_update);
+	if (blink_due && time_before(jiffies + delay, blink_due))
+		mod_delayed_work(vfd->wq, &vfd->flush_work, delay);
+	else
+		queue_delayed_work(vfd->wq, &vfd->flush_work, delay);
 }
 
 static void _display_store(struct vfd_t *vfd, const char *buf, size_t count)
@@ -81,17 +119,84 @@ static void _display_store(struct vfd_t *vfd, const char *buf, size_t count)
 	/* pad with spaces */
 	memset(vfd->display + n, 0, vfd->display_len - n);
 	memcpy(vfd->display, buf, n);
-	vfd->need_update = 1;
+	_need_update (vfd, VFD_NEED_DISPLAY);
+}
+
+/* Wake up scan_work to pick up new animation or scrolling deadlines */
+static void _scan_kick(struct vfd_t *vfd)
+{
+	mod_delayed_work(vfd->wq, &vfd->scan_work, 0);
+}
+
+/* Show the visible part of the scrolled string; called with state_lock held */
+static void _scroll_show(struct vfd_t *vfd)
+{
+	char text [RAW_DISPLAY_WORDS];
+	int i, pos;
+
+	/* the string scrolls out completely before it comes back */
+	for (i = 0; i < vfd->display_len; i++) {
+		pos = (vfd->scroll_pos + i) % (vfd->scroll_len + vfd->display_len);
+		text [i] = (pos < vfd->scroll_len) ? vfd->scroll [pos] : ' ';
+	}
+
+	_display_store (vfd, text, vfd->display_len);
+}
+
+/* Stop playing the animation; called with state_lock held */
+static void _anim_stop(struct vfd_t *vfd)
+{
+	kfree (vfd->anim);
+	vfd->anim = NULL;
+	vfd->anim_len = 0;
+}
+
+/* Userspace takes over the text: stop animation and scrolling */
+static void _text_stop(struct vfd_t *vfd)
+{
+	_anim_stop (vfd);
+	vfd->scroll_len = 0;
+}
+
+/*
+ * Show text from userspace, scrolling it if it doesn't fit on the display.
+ * Called with state_lock held. Returns 1 if scrolling has been started.
+ */
+static int _text_store(struct vfd_t *vfd, const char *buf, size_t count)
+{
+	size_t n = count;
+
+	_text_stop (vfd);
+
+	/* a trailing newline doesn't make a string scroll */
+	if ((n > vfd->display_len) && (buf [n - 1] == '\n'))
+		n--;
+
+	if (n <= vfd->display_len) {
+		_display_store (vfd, buf, count);
+		return 0;
+	}
+
+	vfd->scroll_len = min (n, (size_t)VFD_SCROLL_MAX);
+	memcpy (vfd->scroll, buf, vfd->scroll_len);
+	vfd->scroll_pos = 0;
+	vfd->scroll_due = jiffies + msecs_to_jiffies(VFD_SCROLL_STEP);
+	_scroll_show (vfd);
+	return 1;
 }
 
 static ssize_t display_store(struct device *dev, struct device_attribute *attr,
 	const char *buf, size_t count)
 {
 	struct vfd_t *vfd = dev_get_drvdata(dev);
+	int scroll;
 
-	mutex_lock(&vfd->lock);
-	_display_store (vfd, buf, count);
-	mutex_unlock(&vfd->lock);
+	write_seqlock(&vfd->state_lock);
+	scroll = _text_store (vfd, buf, count);
+	write_sequnlock(&vfd->state_lock);
+
+	if (scroll)
+		_scan_kick (vfd);
 
 	return count;
 }
@@ -133,10 +238,10 @@ static ssize_t overlay_store(struct device *dev, struct device_attribute *attr,
 		cur = skip_nspaces (endp, &left);
 	}
 
-	mutex_lock(&vfd->lock);
+	write_seqlock(&vfd->state_lock);
 	memcpy (vfd->raw_overlay, raw_overlay, i * sizeof (u16));
-	vfd->need_update = 1;
-	mutex_unlock(&vfd->lock);
+	_need_update (vfd, VFD_NEED_DISPLAY);
+	write_sequnlock(&vfd->state_lock);
 
 	return count;
 }
@@ -160,9 +265,9 @@ static ssize_t _u8_store(struct vfd_t *vfd, const char *buf, size_t count, u8 *v
 	if (value > max)
 		value = max;
 
-	mutex_lock(&vfd->lock);
+	write_seqlock(&vfd->state_lock);
 	*val = value;
-	mutex_unlock(&vfd->lock);
+	write_sequnlock(&vfd->state_lock);
 
 	return count;
 }
@@ -172,11 +277,8 @@ static ssize_t enable_store(struct device *dev, struct device_attribute *attr,
 {
 	struct vfd_t *vfd = dev_get_drvdata(dev);
 	ssize_t ret = _u8_store (vfd, buf, count, &vfd->enabled, 1);
-	if (ret > 0) {
-		mutex_lock(&vfd->lock);
-		hardware_update_brightness(vfd);
-		mutex_unlock(&vfd->lock);
-	}
+	if (ret > 0)
+		_need_update (vfd, VFD_NEED_BRIGHTNESS);
 
 	return ret;
 }
@@ -193,11 +295,8 @@ static ssize_t brightness_store(struct device *dev, struct device_attribute *att
 {
 	struct vfd_t *vfd = dev_get_drvdata(dev);
 	ssize_t ret = _u8_store (vfd, buf, count, &vfd->brightness, vfd->brightness_max);
-	if (ret > 0) {
-		mutex_lock(&vfd->lock);
-		hardware_update_brightness (vfd);
-		mutex_unlock(&vfd->lock);
-	}
+	if (ret > 0)
+		_need_update (vfd, VFD_NEED_BRIGHTNESS);
 
 	return ret;
 }
@@ -271,13 +370,13 @@ static ssize_t dotled_store(struct device *dev, struct device_attribute *attr,
 				left -= (endp - cur);
 				cur = endp;
 
-				mutex_lock(&vfd->lock);
+				write_seqlock(&vfd->state_lock);
 				if (ena)
 					vfd->raw_overlay [dotled->word] |= (1 << dotled->bit);
 				else
 					vfd->raw_overlay [dotled->word] &= ~(1 << dotled->bit);
-				vfd->need_update = 1;
-				mutex_unlock(&vfd->lock);
+				_need_update (vfd, VFD_NEED_DISPLAY);
+				write_sequnlock(&vfd->state_lock);
 				break;
 			}
 		}
@@ -295,6 +394,401 @@ error:
 	return count;
 }
 
+/* Find the blink settings of a dot LED or of a digit ("digitN") by name */
+static struct vfd_blink_t *_blink_find(struct vfd_t *vfd, const char *name, int len)
+{
+	int i;
+
+	for (i = 0; i < vfd->num_dotleds; i++)
+		if ((strlen (vfd->dotleds [i].name) == len) &&
+		    (strncmp (vfd->dotleds [i].name, name, len) == 0))
+			return &vfd->dotleds [i].blink;
+
+	if ((len == 6) && (strncmp (name, "digit", 5) == 0) && isdigit (name [5]) &&
+	    (name [5] - '0' < vfd->display_len))
+		return &vfd->digit_blink [name [5] - '0'];
+
+	return NULL;
+}
+
+/* Change blink settings; called with state_lock held */
+static void _blink_set(struct vfd_t *vfd, struct vfd_blink_t *blink,
+	unsigned period, unsigned duty, unsigned phase)
+{
+	/* an element which is never lit or always lit doesn't blink */
+	if ((period > 0xffff) || (duty == 0) || (duty >= period))
+		period = 0;
+
+	if (blink->period)
+		vfd->blinking--;
+	if (period)
+		vfd->blinking++;
+
+	blink->period = period;
+	blink->duty = period ? duty : 0;
+	blink->phase = period ? phase % period : 0;
+	_need_update (vfd, VFD_NEED_DISPLAY);
+}
+
+/*
+ * Check if a blinking element is lit at given realtime (ms), and lower
+ * *next to the number of ms until its state changes.
+ */
+static int _blink_lit(const struct vfd_blink_t *blink, u64 now, unsigned *next)
+{
+	u32 pos;
+	unsigned left;
+
+	if (!blink->period)
+		return 1;
+
+	div_u64_rem(now + blink->period - blink->phase, blink->period, &pos);
+	left = (pos < blink->duty) ? blink->duty - pos : blink->period - pos;
+	if (!*next || (left < *next))
+		*next = left;
+
+	return pos < blink->duty;
+}
+
+/*
+ * Blank the digits and dot LEDs which are in the dark part of their
+ * blink period in the shadow buffers. Returns the number of ms until
+ * the next blink state change, or 0 if nothing blinks.
+ */
+static unsigned _blink_apply(struct vfd_t *vfd, u64 now)
+{
+	int i;
+	unsigned next = 0;
+
+	for (i = 0; i < vfd->display_len; i++)
+		if (!_blink_lit (&vfd->digit_blink [i], now, &next))
+			vfd->shadow_display [i] = ' ';
+
+	for (i = 0; i < vfd->num_dotleds; i++) {
+		struct vfd_dotled_t *dotled = &vfd->dotleds [i];
+		if (!_blink_lit (&dotled->blink, now, &next))
+			vfd->shadow_overlay [dotled->word] &= ~(1 << dotled->bit);
+	}
+
+	return next;
+}
+
+static ssize_t blink_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct vfd_t *vfd = dev_get_drvdata(dev);
+	char *dst = buf;
+	int i;
+
+	for (i = 0; i < vfd->num_dotleds; i++) {
+		struct vfd_blink_t *blink = &vfd->dotleds [i].blink;
+		dst += sprintf(dst, "%s %u %u %u\n", vfd->dotleds [i].name,
+			blink->period, blink->duty, blink->phase);
+	}
+
+	for (i = 0; i < vfd->display_len; i++) {
+		struct vfd_blink_t *blink = &vfd->digit_blink [i];
+		dst += sprintf(dst, "digit%d %u %u %u\n", i,
+			blink->period, blink->duty, blink->phase);
+	}
+
+	return dst - buf;
+}
+
+static ssize_t blink_store(struct device *dev, struct device_attribute *attr,
+	const char *buf, size_t count)
+{
+	struct vfd_t *vfd = dev_get_drvdata(dev);
+	const char *cur = buf;
+	int i, n, left = count;
+	unsigned val [3];
+	struct vfd_blink_t *blink;
+	char *endp;
+
+	for (;;) {
+		cur = skip_nspaces (cur, &left);
+		if (!left)
+			break;
+
+		for (n = 0; (n < left) && !isspace (cur [n]); n++)
+			;
+		if (!(blink = _blink_find (vfd, cur, n)))
+			goto error;
+
+		left -= n;
+		cur += n;
+
+		/* period, duty, phase */
+		for (i = 0; i < ARRAY_SIZE (val); i++) {
+			cur = skip_nspaces (cur, &left);
+			val [i] = simple_strtoul(cur, &endp, 0);
+			if (endp == cur)
+				goto error;
+
+			left -= (endp - cur);
+			cur = endp;
+		}
+
+		write_seqlock(&vfd->state_lock);
+		_blink_set (vfd, blink, val [0], val [1], val [2]);
+		write_sequnlock(&vfd->state_lock);
+	}
+
+	return count;
+
+error:
+	/* unknown garbage found, barf but swallow */
+	dev_err(dev, "garbage encountered at pos %d: [NAME] [PERIOD] [DUTY] [PHASE] expected\n",
+		(int)(cur - buf));
+	return count;
+}
+
+/* Fill a frame with a consistent snapshot of current display state */
+static void _frame_get(struct vfd_t *vfd, struct vfd_frame_t *frame)
+{
+	unsigned seq;
+
+	memset (frame, 0, sizeof (*frame));
+	frame->flags = VFD_FRAME_TEXT | VFD_FRAME_OVERLAY | VFD_FRAME_BRIGHTNESS;
+
+	do {
+		seq = read_seqbegin(&vfd->state_lock);
+		frame->brightness = vfd->brightness;
+		memcpy (frame->text, vfd->display, vfd->display_len);
+		memcpy (frame->overlay, vfd->raw_overlay, sizeof (vfd->raw_overlay));
+	} while (read_seqretry(&vfd->state_lock, seq));
+}
+
+/* Apply the fields of a frame selected by flags; called with state_lock held */
+static void _frame_apply(struct vfd_t *vfd, const struct vfd_frame_t *frame, unsigned flags)
+{
+	if (flags & VFD_FRAME_TEXT)
+		_display_store (vfd, frame->text, strnlen (frame->text, VFD_FRAME_WORDS));
+
+	if (flags & VFD_FRAME_OVERLAY) {
+		memcpy (vfd->raw_overlay, frame->overlay, sizeof (vfd->raw_overlay));
+		_need_update (vfd, VFD_NEED_DISPLAY);
+	}
+
+	if (flags & VFD_FRAME_BRIGHTNESS) {
+		vfd->brightness = min (frame->brightness, vfd->brightness_max);
+		_need_update (vfd, VFD_NEED_BRIGHTNESS);
+	}
+}
+
+/* Apply a frame coming from userspace */
+static void _frame_store(struct vfd_t *vfd, const struct vfd_frame_t *frame)
+{
+	int scroll = 0;
+
+	write_seqlock(&vfd->state_lock);
+	if (frame->flags & VFD_FRAME_TEXT)
+		scroll = _text_store (vfd, frame->text, strnlen (frame->text, VFD_FRAME_WORDS));
+	_frame_apply (vfd, frame, frame->flags & ~VFD_FRAME_TEXT);
+	write_sequnlock(&vfd->state_lock);
+
+	if (scroll)
+		_scan_kick (vfd);
+}
+
+/* Show the next animation step; called with state_lock held */
+static void _anim_step(struct vfd_t *vfd)
+{
+	const struct vfd_anim_step_t *step = &vfd->anim [vfd->anim_pos++];
+
+	if (step->frame.flags & VFD_FRAME_TEXT)
+		vfd->scroll_len = 0;
+	_frame_apply (vfd, &step->frame, step->frame.flags);
+	vfd->anim_due = jiffies + msecs_to_jiffies(step->duration);
+
+	if (step->flags & VFD_ANIM_LOOP)
+		vfd->anim_pos = 0;
+	else if (vfd->anim_pos >= vfd->anim_len)
+		/* the last frame stays on display */
+		_anim_stop (vfd);
+}
+
+/*
+ * Start playing an animation (an array of struct vfd_anim_step_t),
+ * replacing the current one. Returns 0 or -errno.
+ */
+static int _anim_load(struct vfd_t *vfd, const void *data, size_t size)
+{
+	const struct vfd_anim_step_t *steps = data;
+	struct vfd_anim_step_t *anim = NULL;
+	int i, len = size / sizeof (*steps), loop = 0;
+	unsigned total = 0;
+
+	if ((size % sizeof (*steps)) || (len == 0) || (len > VFD_ANIM_STEPS))
+		return -EINVAL;
+
+	for (i = 0; i < len; i++) {
+		total += steps [i].duration;
+		loop |= steps [i].flags & VFD_ANIM_LOOP;
+	}
+
+	/* an endless loop of zero-length frames is not an animation */
+	if (loop && !total)
+		return -EINVAL;
+
+	/* a single zero-length step just stops the animation */
+	if ((len > 1) || total) {
+		anim = kmalloc (size, GFP_KERNEL);
+		if (!anim)
+			return -ENOMEM;
+		memcpy (anim, steps, size);
+	}
+
+	write_seqlock(&vfd->state_lock);
+	_anim_stop (vfd);
+	if (anim) {
+		vfd->anim = anim;
+		vfd->anim_len = len;
+		vfd->anim_pos = 0;
+		vfd->anim_due = jiffies;
+	}
+	write_sequnlock(&vfd->state_lock);
+
+	if (anim)
+		_scan_kick (vfd);
+
+	return 0;
+}
+
+static ssize_t anim_read(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t off, size_t count)
+{
+	struct vfd_t *vfd = dev_get_drvdata(container_of(kobj, struct device, kobj));
+	size_t size;
+
+	/* the animation may be freed by the scan work at any time */
+	write_seqlock(&vfd->state_lock);
+	size = vfd->anim_len * sizeof (struct vfd_anim_step_t);
+	if (off >= size)
+		count = 0;
+	else if (count > size - off)
+		count = size - off;
+	if (count)
+		memcpy (buf, (char *)vfd->anim + off, count);
+	write_sequnlock(&vfd->state_lock);
+
+	return count;
+}
+
+static ssize_t anim_write(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t off, size_t count)
+{
+	struct vfd_t *vfd = dev_get_drvdata(container_of(kobj, struct device, kobj));
+	int ret;
+
+	/* the whole animation must come in a single write */
+	if (off != 0)
+		return -EINVAL;
+
+	ret = _anim_load (vfd, buf, count);
+	return ret ? ret : count;
+}
+
+static ssize_t _power_frame_read(struct vfd_t *vfd, const struct vfd_frame_t *stored,
+	char *buf, loff_t off, size_t count)
+{
+	struct vfd_frame_t frame;
+	unsigned seq;
+
+	if (off >= sizeof (frame))
+		return 0;
+	if (count > sizeof (frame) - off)
+		count = sizeof (frame) - off;
+
+	do {
+		seq = read_seqbegin(&vfd->state_lock);
+		memcpy (&frame, stored, sizeof (frame));
+	} while (read_seqretry(&vfd->state_lock, seq));
+
+	memcpy (buf, (char *)&frame + off, count);
+	return count;
+}
+
+static ssize_t _power_frame_write(struct vfd_t *vfd, struct vfd_frame_t *stored,
+	const char *buf, loff_t off, size_t count)
+{
+	if ((off != 0) || (count != sizeof (struct vfd_frame_t)))
+		return -EINVAL;
+
+	/* kept until suspend or shutdown */
+	write_seqlock(&vfd->state_lock);
+	memcpy (stored, buf, sizeof (*stored));
+	write_sequnlock(&vfd->state_lock);
+
+	return count;
+}
+
+static ssize_t suspend_frame_read(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t off, size_t count)
+{
+	struct vfd_t *vfd = dev_get_drvdata(container_of(kobj, struct device, kobj));
+	return _power_frame_read (vfd, &vfd->suspend_frame, buf, off, count);
+}
+
+static ssize_t suspend_frame_write(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t off, size_t count)
+{
+	struct vfd_t *vfd = dev_get_drvdata(container_of(kobj, struct device, kobj));
+	return _power_frame_write (vfd, &vfd->suspend_frame, buf, off, count);
+}
+
+static ssize_t shutdown_frame_read(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t off, size_t count)
+{
+	struct vfd_t *vfd = dev_get_drvdata(container_of(kobj, struct device, kobj));
+	return _power_frame_read (vfd, &vfd->shutdown_frame, buf, off, count);
+}
+
+static ssize_t shutdown_frame_write(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t off, size_t count)
+{
+	struct vfd_t *vfd = dev_get_drvdata(container_of(kobj, struct device, kobj));
+	return _power_frame_write (vfd, &vfd->shutdown_frame, buf, off, count);
+}
+
+static ssize_t wakeups_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct vfd_t *vfd = dev_get_drvdata(dev);
+	return sprintf(buf, "scan %lu flush %lu\n", vfd->scan_wakeups, vfd->flush_wakeups);
+}
+
+static ssize_t frame_read(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t off, size_t count)
+{
+	struct vfd_t *vfd = dev_get_drvdata(container_of(kobj, struct device, kobj));
+	struct vfd_frame_t frame;
+
+	if (off >= sizeof (frame))
+		return 0;
+	if (count > sizeof (frame) - off)
+		count = sizeof (frame) - off;
+
+	_frame_get (vfd, &frame);
+
+	memcpy (buf, (char *)&frame + off, count);
+	return count;
+}
+
+static ssize_t frame_write(struct file *filp, struct kobject *kobj,
+	struct bin_attribute *attr, char *buf, loff_t off, size_t count)
+{
+	struct vfd_t *vfd = dev_get_drvdata(container_of(kobj, struct device, kobj));
+
+	/* partial frames would defeat the purpose */
+	if ((off != 0) || (count != sizeof (struct vfd_frame_t)))
+		return -EINVAL;
+
+	_frame_store (vfd, (struct vfd_frame_t *)buf);
+
+	return count;
+}
+
 static DEVICE_ATTR_RO(key);
 static DEVICE_ATTR_RW(display);
 static DEVICE_ATTR_RW(overlay);
@@ -303,13 +797,253 @@ static DEVICE_ATTR_RW(brightness);
 static DEVICE_ATTR_RO(brightness_max);
 static DEVICE_ATTR_RW(brightness_suspend);
 static DEVICE_ATTR_RW(dotled);
+static DEVICE_ATTR_RO(wakeups);
+static DEVICE_ATTR_RW(blink);
 
 static const struct device_attribute *all_attrs [] = {
 	&dev_attr_key, &dev_attr_display, &dev_attr_overlay, &dev_attr_enable,
 	&dev_attr_brightness, &dev_attr_brightness_max, &dev_attr_brightness_suspend,
-	&dev_attr_dotled,
+	&dev_attr_dotled, &dev_attr_wakeups, &dev_attr_blink,
+};
+
+static BIN_ATTR_RW(frame, sizeof (struct vfd_frame_t));
+static BIN_ATTR_RW(anim, VFD_ANIM_STEPS * sizeof (struct vfd_anim_step_t));
+static BIN_ATTR_RW(suspend_frame, sizeof (struct vfd_frame_t));
+static BIN_ATTR_RW(shutdown_frame, sizeof (struct vfd_frame_t));
+
+static const struct bin_attribute *all_bin_attrs [] = {
+	&bin_attr_frame, &bin_attr_anim, &bin_attr_suspend_frame, &bin_attr_shutdown_frame,
+};
+
+//***//***//***//***//***// character device //***//***//***//***//***//
+
+static struct vfd_t *file_vfd(struct file *file)
+{
+	/* misc_open() points private_data to our miscdevice */
+	return container_of(file->private_data, struct vfd_t, misc);
+}
+
+/* Called on the last reference drop, see vfd_t.ref */
+static void vfd_free(struct kref *ref)
+{
+	struct vfd_t *vfd = container_of(ref, struct vfd_t, ref);
+
+	/* a page still mapped somewhere stays alive until its last munmap() */
+	if (vfd->shared_frame)
+		free_page((unsigned long)vfd->shared_frame);
+	kfree(vfd->dotleds);
+	kfree(vfd->anim);
+	kfree(vfd);
+}
+
+/* Lock the device for a /dev/vfd call; NULL if the device has been removed */
+static struct vfd_t *cdev_lock(struct file *file)
+{
+	struct vfd_t *vfd = file_vfd(file);
+
+	mutex_lock(&vfd->cdev_lock);
+	if (vfd->cdev_dead) {
+		mutex_unlock(&vfd->cdev_lock);
+		return NULL;
+	}
+
+	return vfd;
+}
+
+static int vfd_cdev_open(struct inode *inode, struct file *file)
+{
+	/* misc_open() holds misc_mtx, so we can't race with misc_deregister() */
+	kref_get(&file_vfd(file)->ref);
+	return 0;
+}
+
+static int vfd_cdev_release(struct inode *inode, struct file *file)
+{
+	kref_put(&file_vfd(file)->ref, vfd_free);
+	return 0;
+}
+
+static ssize_t vfd_cdev_read(struct file *file, char __user *buf,
+	size_t count, loff_t *ppos)
+{
+	struct vfd_t *vfd;
+	struct vfd_frame_t frame;
+
+	/* the device reads as a single frame */
+	if (*ppos >= sizeof (frame))
+		return 0;
+	if (count < sizeof (frame))
+		return -EINVAL;
+
+	if (!(vfd = cdev_lock (file)))
+		return -ENODEV;
+	_frame_get (vfd, &frame);
+	mutex_unlock(&vfd->cdev_lock);
+
+	if (copy_to_user (buf, &frame, sizeof (frame)))
+		return -EFAULT;
+
+	*ppos += sizeof (frame);
+	return sizeof (frame);
+}
+
+static ssize_t vfd_cdev_write(struct file *file, const char __user *buf,
+	size_t count, loff_t *ppos)
+{
+	struct vfd_t *vfd;
+	struct vfd_frame_t frame;
+
+	if (count != sizeof (frame))
+		return -EINVAL;
+
+	if (copy_from_user (&frame, buf, sizeof (frame)))
+		return -EFAULT;
+
+	if (!(vfd = cdev_lock (file)))
+		return -ENODEV;
+	_frame_store (vfd, &frame);
+	mutex_unlock(&vfd->cdev_lock);
+
+	return count;
+}
+
+static long vfd_cdev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct vfd_t *vfd;
+	struct vfd_frame_t frame;
+	int value;
+	long ret = 0;
+
+	if (((cmd == VFD_IOC_SET_BRIGHTNESS) || (cmd == VFD_IOC_SET_ENABLE)) &&
+	    get_user (value, (int __user *)arg))
+		return -EFAULT;
+
+	if (!(vfd = cdev_lock (file)))
+		return -ENODEV;
+
+	switch (cmd) {
+		case VFD_IOC_SET_BRIGHTNESS:
+		case VFD_IOC_SET_ENABLE:
+			if (value < 0) {
+				ret = -EINVAL;
+				break;
+			}
+
+			write_seqlock(&vfd->state_lock);
+			if (cmd == VFD_IOC_SET_BRIGHTNESS)
+				vfd->brightness = min (value, (int)vfd->brightness_max);
+			else
+				vfd->enabled = value ? 1 : 0;
+			_need_update (vfd, VFD_NEED_BRIGHTNESS);
+			write_sequnlock(&vfd->state_lock);
+			break;
+
+		case VFD_IOC_FLUSH:
+			/* snapshot the shared page so userspace can't change it under us */
+			memcpy (&frame, vfd->shared_frame, sizeof (frame));
+
+			_frame_store (vfd, &frame);
+			break;
+
+		case VFD_IOC_GET_FRAME:
+			_frame_get (vfd, &frame);
+
+			if (copy_to_user ((void __user *)arg, &frame, sizeof (frame)))
+				ret = -EFAULT;
+			break;
+
+		default:
+			ret = -ENOTTY;
+			break;
+	}
+
+	mutex_unlock(&vfd->cdev_lock);
+	return ret;
+}
+
+/* Every mapping pins the shared page, so it outlives the device if needed */
+static void vfd_vm_open(struct vm_area_struct *vma)
+{
+	get_page(virt_to_page(vma->vm_private_data));
+}
+
+static void vfd_vm_close(struct vm_area_struct *vma)
+{
+	put_page(virt_to_page(vma->vm_private_data));
+}
+
+static const struct vm_operations_struct vfd_vm_ops = {
+	.open		= vfd_vm_open,
+	.close		= vfd_vm_close,
 };
 
+static int vfd_cdev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct vfd_t *vfd;
+	int ret;
+
+	if ((vma->vm_pgoff != 0) || (vma->vm_end - vma->vm_start > PAGE_SIZE))
+		return -EINVAL;
+
+	if (!(vfd = cdev_lock (file)))
+		return -ENODEV;
+
+	ret = remap_pfn_range (vma, vma->vm_start,
+		virt_to_phys (vfd->shared_frame) >> PAGE_SHIFT,
+		vma->vm_end - vma->vm_start, vma->vm_page_prot);
+	if (ret == 0) {
+		/* vm_ops->open() is only called on copies, not on the first mapping */
+		vma->vm_private_data = vfd->shared_frame;
+		vma->vm_ops = &vfd_vm_ops;
+		vfd_vm_open (vma);
+	}
+
+	mutex_unlock(&vfd->cdev_lock);
+	return ret;
+}
+
+static const struct file_operations vfd_cdev_fops = {
+	.owner		= THIS_MODULE,
+	.open		= vfd_cdev_open,
+	.release	= vfd_cdev_release,
+	.read		= vfd_cdev_read,
+	.write		= vfd_cdev_write,
+	.unlocked_ioctl	= vfd_cdev_ioctl,
+	.mmap		= vfd_cdev_mmap,
+	.llseek		= default_llseek,
+};
+
+/* Register the /dev/vfd device */
+static __init int __setup_cdev (struct platform_device *pdev, struct vfd_t *vfd)
+{
+	int ret;
+
+	vfd->shared_frame = (struct vfd_frame_t *)get_zeroed_page(GFP_KERNEL);
+	if (!vfd->shared_frame)
+		return -ENOMEM;
+
+	vfd->misc.minor = MISC_DYNAMIC_MINOR;
+	vfd->misc.name = "vfd";
+	vfd->misc.fops = &vfd_cdev_fops;
+	vfd->misc.parent = &pdev->dev;
+
+	if ((ret = misc_register(&vfd->misc)) < 0)
+		vfd->misc.fops = NULL;
+
+	return ret;
+}
+
+/* Unregister /dev/vfd; files still open keep vfd alive but fail all calls */
+static void __free_cdev (struct vfd_t *vfd)
+{
+	if (vfd->misc.fops)
+		misc_deregister(&vfd->misc);
+
+	mutex_lock(&vfd->cdev_lock);
+	vfd->cdev_dead = 1;
+	mutex_unlock(&vfd->cdev_lock);
+}
+
 //***//***//***//***//***//***// input support //***//***//***//***//***//***//
 
 #ifndef CONFIG_VFD_NO_KEY_INPUT
@@ -365,37 +1099,108 @@ static void vfd_scan_keys(struct vfd_t *vfd)
 }
 #endif
 
-//***//***//***//***//***//***// timer interrupt //***//***//***//***//***//***//
+//***//***//***//***//***//***// display flush //***//***//***//***//***//***//
 
-static char boot_anim [][4] = {
-	"boot",
-	"b__t",
-	"boot",
-	"b00t",
-	"b**t",
-	"b~~t",
-};
+static void vfd_flush_work(struct work_struct *work)
+{
+	struct vfd_t *vfd = container_of(to_delayed_work(work), struct vfd_t, flush_work);
+	unsigned seq, next = 0;
+	u64 now;
+
+	mutex_lock(&vfd->lock);
+	vfd->flush_wakeups++;
+	vfd->blink_due = 0;
+
+	/* the suspend frame stays until resume, which flushes everything */
+	if (vfd->suspended) {
+		mutex_unlock(&vfd->lock);
+		return;
+	}
+
+	/* changes made after the bit is cleared will queue another flush;
+	 * while anything blinks, the display is re-evaluated on every run */
+	if (test_and_clear_bit(VFD_NEED_DISPLAY, &vfd->need_update) || vfd->blinking) {
+		/* blinking is synchronized to the wall clock */
+		now = ktime_to_ms(ktime_get_real());
+
+		do {
+			seq = read_seqbegin(&vfd->state_lock);
+			memcpy (vfd->shadow_display, vfd->display, sizeof (vfd->shadow_display));
+			memcpy (vfd->shadow_overlay, vfd->raw_overlay, sizeof (vfd->shadow_overlay));
+			next = _blink_apply (vfd, now);
+		} while (read_seqretry(&vfd->state_lock, seq));
+
+		hardware_update_display (vfd);
+	}
+
+	if (test_and_clear_bit(VFD_NEED_BRIGHTNESS, &vfd->need_update))
+		hardware_update_brightness (vfd);
+
+	vfd->last_flush = jiffies;
+	mutex_unlock(&vfd->lock);
+
+	/* wake up right after the next blink state change */
+	if (next) {
+		vfd->blink_due = jiffies + msecs_to_jiffies(next + 1);
+		queue_delayed_work(vfd->wq, &vfd->flush_work, msecs_to_jiffies(next + 1));
+	}
+}
+
+//***//***//***//***//***//***// periodic scan //***//***//***//***//***//***//
+
+/* Lower *next (jiffies from now, 0 if nothing is due yet) to the time left until due */
+static void _next_due(unsigned long *next, unsigned long due)
+{
+	unsigned long left = time_before(jiffies, due) ? due - jiffies : 1;
+
+	if (!*next || (left < *next))
+		*next = left;
+}
 
-void vfd_timer_sr(unsigned long data)
+static void vfd_scan_work(struct work_struct *work)
 {
-	struct vfd_t *vfd = (struct vfd_t *)data;
+	struct vfd_t *vfd = container_of(to_delayed_work(work), struct vfd_t, scan_work);
+	unsigned long next = 0;
+
+	/* resume restarts scanning */
+	if (vfd->suspended)
+		return;
+
+	vfd->scan_wakeups++;
 
 #ifndef CONFIG_VFD_NO_KEY_INPUT
-	if (vfd->input)
-		vfd_scan_keys(vfd);
+	/* scan faster while a key is held, to catch the release quickly */
+	if (vfd->input) {
+		if (!time_before(jiffies, vfd->keys_due)) {
+			vfd_scan_keys(vfd);
+			vfd->keys_due = jiffies + msecs_to_jiffies(
+				vfd->keystate ? VFD_SCAN_FAST : VFD_SCAN_IDLE);
+		}
+		_next_due(&next, vfd->keys_due);
+	}
 #endif
 
-	if (unlikely (vfd->boot_anim)) {
-		vfd->boot_anim--;
-		_display_store(vfd, boot_anim [vfd->boot_anim], 4);
-	}
+	write_seqlock(&vfd->state_lock);
 
-	if (unlikely (vfd->need_update)) {
-		vfd->need_update = 0;
-		hardware_update_display (vfd);
+	if (vfd->anim_len && !time_before(jiffies, vfd->anim_due))
+		_anim_step(vfd);
+	if (vfd->anim_len)
+		_next_due(&next, vfd->anim_due);
+
+	if (vfd->scroll_len && !time_before(jiffies, vfd->scroll_due)) {
+		vfd->scroll_pos = (vfd->scroll_pos + 1) % (vfd->scroll_len + vfd->display_len);
+		vfd->scroll_due = jiffies + msecs_to_jiffies(VFD_SCROLL_STEP);
+		_scroll_show(vfd);
 	}
+	if (vfd->scroll_len)
+		_next_due(&next, vfd->scroll_due);
 
-	mod_timer(&vfd->timer, jiffies + msecs_to_jiffies(100));
+	write_sequnlock(&vfd->state_lock);
+
+	/* with no keys, animation or scrolling, display changes are flushed
+	 * on demand by flush_work, so there's no reason to wake up at all */
+	if (next)
+		queue_delayed_work(vfd->wq, &vfd->scan_work, next);
 }
 
 //***//***//***//***// Platform device implementation //***//***//***//***//
@@ -428,15 +1233,73 @@ static __init int __setup_gpios (struct platform_device *pdev, struct vfd_t *vfd
 	return 0;
 }
 
-/* Set up dot LEDs */
+/* Set up bus timing: explicit delays from DTS, or calibrate at init */
+static __init void __setup_timing (struct platform_device *pdev, struct vfd_t *vfd)
+{
+	u32 val;
+
+	vfd->bus_delay_ns = -1;
+	vfd->stb_delay_ns = -1;
+
+	if (of_property_read_u32(pdev->dev.of_node, "bus_delay_ns", &val) == 0)
+		vfd->bus_delay_ns = val;
+	if (of_property_read_u32(pdev->dev.of_node, "stb_delay_ns", &val) == 0)
+		vfd->stb_delay_ns = val;
+}
+
+static const char boot_anim [][4] = {
+	"b~~t",
+	"b**t",
+	"b00t",
+	"boot",
+	"b__t",
+	"boot",
+};
+
+/* Start the boot animation: from firmware if DTS names one, or the built-in one */
+static __init void __setup_anim (struct platform_device *pdev, struct vfd_t *vfd)
+{
+	struct vfd_anim_step_t steps [ARRAY_SIZE (boot_anim)];
+	const struct firmware *fw;
+	const char *name;
+	int i, ret;
+
+	if (of_property_read_string(pdev->dev.of_node, "anim_firmware", &name) == 0) {
+		/* no usermode helper fallback, it could stall the boot; this also
+		 * means that a built-in driver, probed before the root filesystem
+		 * is mounted, only finds the file in CONFIG_EXTRA_FIRMWARE */
+		if ((ret = request_firmware_direct(&fw, name, &pdev->dev)) == 0) {
+			ret = _anim_load (vfd, fw->data, fw->size);
+			release_firmware(fw);
+		}
+
+		if (ret == 0)
+			return;
+
+		dev_err(&pdev->dev, "failed to load animation %s: %d\n", name, ret);
+	}
+
+	memset (steps, 0, sizeof (steps));
+	for (i = 0; i < ARRAY_SIZE (boot_anim); i++) {
+		steps [i].duration = VFD_BOOT_ANIM_STEP;
+		steps [i].frame.flags = VFD_FRAME_TEXT;
+		memcpy (steps [i].frame.text, boot_anim [i], sizeof (boot_anim [i]));
+	}
+
+	_anim_load (vfd, steps, sizeof (steps));
+}
+
+/* Set up dot LEDs; num_dotleds stays 0 unless dotleds is complete */
 static __init int __setup_dotled (struct platform_device *pdev, struct vfd_t *vfd)
 {
-	int i;
+	int i, num;
 	struct property *prop;
+	struct vfd_dotled_t *dotleds;
 	u8 *ptr;
 
-	vfd->num_dotleds = of_property_count_strings(pdev->dev.of_node, "dot_names");
-	if (vfd->num_dotleds <= 0)
+	vfd->num_dotleds = 0;
+	num = of_property_count_strings(pdev->dev.of_node, "dot_names");
+	if (num <= 0)
 		return 0;
 
 	prop = of_find_property(pdev->dev.of_node, "dot_bits", NULL);
@@ -444,25 +1307,30 @@ static __init int __setup_dotled (struct platform_device *pdev, struct vfd_t *vf
 		dev_err(&pdev->dev, "dot_names defined, but dot_bits is empty!\n");
 		return 0;
 	}
-	if (prop->length != (vfd->num_dotleds * 2 * sizeof (u8))) {
+	if (prop->length != (num * 2 * sizeof (u8))) {
 		dev_err(&pdev->dev, "Number of entries mismatch in dot_names (%d) and dot_bits (%d)!\n",
-			vfd->num_dotleds, (int)(prop->length / (2 * sizeof (u8))));
+			num, (int)(prop->length / (2 * sizeof (u8))));
 		return 0;
 	}
 
-	vfd->dotleds = kmalloc (vfd->num_dotleds * sizeof (struct vfd_dotled_t), GFP_KERNEL);
+	dotleds = kzalloc (num * sizeof (struct vfd_dotled_t), GFP_KERNEL);
+	if (!dotleds)
+		return -ENOMEM;
+
 	ptr = (u8 *)prop->value;
-	for (i = 0; i < vfd->num_dotleds; i++) {
+	for (i = 0; i < num; i++) {
 		if (of_property_read_string_index(pdev->dev.of_node, "dot_names",
-			i, &vfd->dotleds [i].name) != 0)
+			i, &dotleds [i].name) != 0)
 			/* this should never happen */
-			vfd->dotleds [i].name = "*BUG*";
-		vfd->dotleds [i].word = *ptr++;
-		vfd->dotleds [i].bit  = *ptr++;
+			dotleds [i].name = "*BUG*";
+		dotleds [i].word = *ptr++;
+		dotleds [i].bit  = *ptr++;
 		DBG_PRINT ("dot led '%s', word %d, bit %d\n",
-			vfd->dotleds [i].name, vfd->dotleds [i].word, vfd->dotleds [i].bit);
+			dotleds [i].name, dotleds [i].word, dotleds [i].bit);
 	}
 
+	vfd->dotleds = dotleds;
+	vfd->num_dotleds = num;
 	return 0;
 }
 
@@ -525,36 +1393,61 @@ static int __init vfd_probe(struct platform_device *pdev)
 	if (!vfd)
 		return -ENOMEM;
 
+	kref_init(&vfd->ref);
 	mutex_init(&vfd->lock);
+	mutex_init(&vfd->cdev_lock);
+	seqlock_init(&vfd->state_lock);
 	platform_set_drvdata(pdev, vfd);
 
 	if ((ret = __setup_gpios (pdev, vfd)) < 0)
 		goto err1;
 
+	__setup_timing (pdev, vfd);
+
 	if ((ret = hardware_init(vfd)) != 0) {
 		dev_err(&pdev->dev, "vfd hardware init failed!\n");
 		goto err1;
 	}
 
-	/* display boot animation */
-	vfd->boot_anim = ARRAY_SIZE (boot_anim);
+	/* all bus I/O is done from an ordered workqueue, so that it never
+	 * runs in atomic context and never races with itself */
+	vfd->wq = alloc_ordered_workqueue("vfd", 0);
+	if (!vfd->wq) {
+		ret = -ENOMEM;
+		goto err1;
+	}
 
-	setup_timer(&vfd->timer, vfd_timer_sr, (unsigned long)vfd);
-	mod_timer(&vfd->timer, jiffies+msecs_to_jiffies(100));
+	INIT_DELAYED_WORK(&vfd->scan_work, vfd_scan_work);
+	INIT_DELAYED_WORK(&vfd->flush_work, vfd_flush_work);
+	vfd->last_flush = jiffies;
+	vfd->keys_due = jiffies;
+
+	/* create the dot-LED objects before anything can queue a flush */
+	if ((ret =  __setup_dotled (pdev, vfd)) < 0)
+		goto err2;
+
+	/* display boot animation */
+	__setup_anim (pdev, vfd);
 
 	/* register sysfs attributes */
 	for (i = 0; i < ARRAY_SIZE (all_attrs); i++)
 		if ((ret = device_create_file(&pdev->dev, all_attrs [i])) < 0)
 			goto err2;
-
-	/* create the dot-LED objects */
-	if ((ret =  __setup_dotled (pdev, vfd)) < 0)
-		goto err2;
+	for (i = 0; i < ARRAY_SIZE (all_bin_attrs); i++)
+		if ((ret = device_create_bin_file(&pdev->dev, all_bin_attrs [i])) < 0)
+			goto err2;
 
 	/* set up input device, if needed */
 	if ((ret = __setup_input (pdev, vfd)) < 0)
 		goto err2;
 
+	/* create /dev/vfd */
+	if ((ret = __setup_cdev (pdev, vfd)) < 0)
+		goto err2;
+
+	/* start scanning keys, if any */
+	_scan_kick (vfd);
+
 #ifdef CONFIG_HAS_EARLYSUSPEND
 	vfd->early_suspend.level = EARLY_SUSPEND_LEVEL_BLANK_SCREEN;
 	vfd->early_suspend.suspend = vfd_early_suspend;
@@ -565,12 +1458,19 @@ static int __init vfd_probe(struct platform_device *pdev)
 	return 0;
 
 err2:
+	/* userspace can't queue any more work once its interfaces are gone */
+	__free_cdev (vfd);
+	for (i = ARRAY_SIZE (all_bin_attrs) - 1; i >= 0; i--)
+		device_remove_bin_file (&pdev->dev, all_bin_attrs [i]);
 	for (i = ARRAY_SIZE (all_attrs) - 1; i >= 0; i--)
 		device_remove_file (&pdev->dev, all_attrs [i]);
+	cancel_delayed_work_sync(&vfd->scan_work);
+	cancel_delayed_work_sync(&vfd->flush_work);
+	destroy_workqueue(vfd->wq);
 err1:
 	if (vfd->input != NULL)
 		input_free_device(vfd->input);
-	kfree(vfd);
+	kref_put(&vfd->ref, vfd_free);
 
 	return ret;
 }
@@ -584,14 +1484,24 @@ static int vfd_remove(struct platform_device *pdev)
 	unregister_early_suspend (&vfd->early_suspend);
 #endif
 
-	/* unregister everything */
+	/* unregister everything userspace could use to queue more work */
+	__free_cdev (vfd);
+	for (i = ARRAY_SIZE (all_bin_attrs) - 1; i >= 0; i--)
+		device_remove_bin_file (&pdev->dev, all_bin_attrs [i]);
 	for (i = ARRAY_SIZE (all_attrs) - 1; i >= 0; i--)
 		device_remove_file (&pdev->dev, all_attrs [i]);
 
+	/* scan_work may queue flush_work, so it goes first;
+	 * cancel_delayed_work_sync() copes with works requeueing themselves */
+	cancel_delayed_work_sync(&vfd->scan_work);
+	cancel_delayed_work_sync(&vfd->flush_work);
+	destroy_workqueue(vfd->wq);
+
 	if (vfd->input != NULL)
 		input_free_device(vfd->input);
 
-	kfree(vfd);
+	/* open /dev/vfd files hold their own references */
+	kref_put(&vfd->ref, vfd_free);
 
 	return 0;
 }
@@ -620,37 +1530,95 @@ static void vfd_early_suspend (struct early_suspend *h)
 }
 #endif
 
-static int vfd_power_common (struct platform_device *pdev, int suspend)
+/*
+ * Show the preloaded suspend or shutdown frame, if any. Only the shadow
+ * buffers are changed, so the live content is intact for resume.
+ * Called with the bus lock held.
+ */
+static void _power_frame_show(struct vfd_t *vfd, const struct vfd_frame_t *stored)
+{
+	struct vfd_frame_t frame;
+	unsigned seq;
+
+	do {
+		seq = read_seqbegin(&vfd->state_lock);
+		memcpy (&frame, stored, sizeof (frame));
+		memcpy (vfd->shadow_display, vfd->display, sizeof (vfd->shadow_display));
+		memcpy (vfd->shadow_overlay, vfd->raw_overlay, sizeof (vfd->shadow_overlay));
+	} while (read_seqretry(&vfd->state_lock, seq));
+
+	/* the frame brightness, if any, overrides the suspend brightness */
+	vfd->brightness_frame = (frame.flags & VFD_FRAME_BRIGHTNESS) ?
+		min (frame.brightness, vfd->brightness_max) : vfd->brightness_suspend;
+
+	if (!frame.flags)
+		return;
+
+	if (frame.flags & VFD_FRAME_TEXT) {
+		memset (vfd->shadow_display, 0, sizeof (vfd->shadow_display));
+		memcpy (vfd->shadow_display, frame.text,
+			strnlen (frame.text, min (VFD_FRAME_WORDS, vfd->display_len)));
+	}
+
+	if (frame.flags & VFD_FRAME_OVERLAY)
+		memcpy (vfd->shadow_overlay, frame.overlay, sizeof (vfd->shadow_overlay));
+
+	hardware_update_display (vfd);
+}
+
+/*
+ * Suspend, showing given frame (the suspend or shutdown frame), or resume
+ * if frame is NULL. Everything is done here, since userspace is already
+ * frozen on suspend and not yet running on resume.
+ */
+static int vfd_power_common (struct platform_device *pdev, const struct vfd_frame_t *frame)
 {
 	struct vfd_t *vfd = platform_get_drvdata(pdev);
 
+	if (frame) {
+		/* animation, scrolling and blinking must not touch the frame */
+		cancel_delayed_work_sync(&vfd->scan_work);
+		cancel_delayed_work_sync(&vfd->flush_work);
+
+		mutex_lock(&vfd->lock);
+		_power_frame_show(vfd, frame);
+		hardware_suspend(vfd, 1);
+		mutex_unlock(&vfd->lock);
+		return 0;
+	}
+
 	mutex_lock(&vfd->lock);
-	hardware_suspend(vfd, suspend);
+	hardware_suspend(vfd, 0);
 	mutex_unlock(&vfd->lock);
 
+	/* bring back the live content */
+	_need_update (vfd, VFD_NEED_DISPLAY);
+	_scan_kick (vfd);
+
 	/* we only care about resume here, suspend is handled in earlysuspend */
-	if (!suspend)
-		uevent_suspend (pdev, suspend);
+	uevent_suspend (pdev, 0);
 
 	return 0;
 }
 
 static int vfd_suspend(struct platform_device *pdev, pm_message_t state)
 {
+	struct vfd_t *vfd = platform_get_drvdata(pdev);
 	DBG_TRACE;
-	return vfd_power_common (pdev, 1);
+	return vfd_power_common (pdev, &vfd->suspend_frame);
 }
 
 static int vfd_resume(struct platform_device *pdev)
 {
 	DBG_TRACE;
-	return vfd_power_common (pdev, 0);
+	return vfd_power_common (pdev, NULL);
 }
 
 static void vfd_shutdown(struct platform_device *pdev)
 {
+	struct vfd_t *vfd = platform_get_drvdata(pdev);
 	DBG_TRACE;
-	vfd_power_common (pdev, 1);
+	vfd_power_common (pdev, &vfd->shutdown_frame);
 }
 
 static const struct of_device_id vfd_dt_match[]={
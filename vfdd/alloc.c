@@ -0,0 +1,48 @@
+/*
+ * Heap allocation counter. In debug builds (ALLOC_STATS) the linker
+ * redirects malloc & co called from vfdd to these wrappers (see -Wl,--wrap
+ * in the makefiles), so that statistics can show who allocates memory while
+ * running. Allocations made inside libc itself (stdio buffers, locale data
+ * etc.) don't go through the wrappers and are not counted.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vfdd.h"
+
+/* number of heap allocations made by vfdd, for statistics */
+unsigned long g_allocs = 0;
+
+#ifdef ALLOC_STATS
+
+extern void *__real_malloc (size_t size);
+extern void *__real_calloc (size_t nmemb, size_t size);
+extern void *__real_realloc (void *ptr, size_t size);
+extern char *__real_strdup (const char *s);
+
+void *__wrap_malloc (size_t size)
+{
+	g_allocs++;
+	return __real_malloc (size);
+}
+
+void *__wrap_calloc (size_t nmemb, size_t size)
+{
+	g_allocs++;
+	return __real_calloc (nmemb, size);
+}
+
+void *__wrap_realloc (void *ptr, size_t size)
+{
+	g_allocs++;
+	return __real_realloc (ptr, size);
+}
+
+char *__wrap_strdup (const char *s)
+{
+	g_allocs++;
+	return __real_strdup (s);
+}
+
+#endif /* ALLOC_STATS */
@@ -4,8 +4,13 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_MODULE := vfdd
-LOCAL_SRC_FILES := $(addprefix ../,vfdd.c cfg_parse/cfg_parse.c cfg.c sysfs.c task.c \
+LOCAL_SRC_FILES := $(addprefix ../,vfdd.c cfg_parse/cfg_parse.c cfg.c sysfs.c alloc.c task.c \
 	task-display.c task-suspend.c task-clock.c task-temp.c task-disk.c task-dot.c)
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/../cfg_parse
+# the debug build counts heap allocations, see alloc.c
+ifeq ($(APP_OPTIM),debug)
+LOCAL_CFLAGS := -DALLOC_STATS
+LOCAL_LDFLAGS := -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=strdup
+endif
 
 include $(BUILD_EXECUTABLE)
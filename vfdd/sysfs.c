@@ -8,36 +8,45 @@
 
 #include "vfdd.h"
 
+/* number of syscalls made by sysfs helpers, for statistics */
+unsigned long g_sysfs_syscalls = 0;
+
 char *sysfs_read (const char *device_attr)
 {
 	int h, n;
 	off_t fsize;
 	char tmp [1000];
 
+	g_sysfs_syscalls++;
 	h = open (device_attr, O_RDONLY);
 	if (h < 0)
 		goto error;
 
+	g_sysfs_syscalls++;
 	fsize = lseek (h, 0, SEEK_END);
 	if (fsize < 0)
 		goto error;
 
 	if (fsize >= sizeof (tmp))
 		fsize = sizeof (tmp) - 1;
+	g_sysfs_syscalls += 2;
 	lseek (h, 0, SEEK_SET);
 	n = read (h, tmp, fsize);
 	if (n <= 0)
 		goto error;
 	tmp [n] = 0;
 
+	g_sysfs_syscalls++;
 	close (h);
 	return strdup (tmp);
 
 error:
 	trace ("failed to read sysfs attr from %s\n", device_attr);
 
-	if (h >= 0)
+	if (h >= 0) {
+		g_sysfs_syscalls++;
 		close (h);
+	}
 	return NULL;
 }
 
@@ -66,22 +75,27 @@ int sysfs_write (const char *device_attr, const char *value)
 {
 	int h, n;
 
+	g_sysfs_syscalls++;
 	h = open (device_attr, O_TRUNC | O_WRONLY);
 	if (h < 0)
 		goto error;
 
 	n = strlen (value);
+	g_sysfs_syscalls++;
 	if (write (h, value, n) != n)
 		goto error;
 
+	g_sysfs_syscalls++;
 	close (h);
 	return 0;
 
 error:
 	trace ("failed to write attr [%s] into %s\n", value, device_attr);
 
-	if (h >= 0)
+	if (h >= 0) {
+		g_sysfs_syscalls++;
 		close (h);
+	}
 	return -1;
 }
 
@@ -101,5 +115,136 @@ int sysfs_set_int (const char *device, const char *attr, int value)
 
 int sysfs_exists (const char *device_attr)
 {
+	g_sysfs_syscalls++;
 	return access (device_attr, F_OK);
 }
+
+static int sysfs_attr_reopen (struct sysfs_attr_t *attr)
+{
+	if (attr->fd >= 0) {
+		g_sysfs_syscalls++;
+		close (attr->fd);
+	}
+
+	g_sysfs_syscalls++;
+	attr->fd = open (attr->path, attr->mode | O_CLOEXEC);
+	return attr->fd;
+}
+
+int sysfs_attr_open (struct sysfs_attr_t *attr, const char *device, const char *name, int mode)
+{
+	int n;
+
+	if (device) {
+		n = strlen (device) + 1 + strlen (name) + 1;
+		attr->path = malloc (n);
+		snprintf (attr->path, n, "%s/%s", device, name);
+	} else
+		attr->path = strdup (name);
+
+	attr->fd = -1;
+	attr->mode = mode;
+
+	if (sysfs_attr_reopen (attr) < 0) {
+		trace ("failed to open sysfs attr %s\n", attr->path);
+		return -1;
+	}
+
+	return 0;
+}
+
+void sysfs_attr_close (struct sysfs_attr_t *attr)
+{
+	/* never opened */
+	if (!attr->path)
+		return;
+
+	if (attr->fd >= 0)
+		close (attr->fd);
+	attr->fd = -1;
+
+	free (attr->path);
+	attr->path = NULL;
+}
+
+int sysfs_attr_read (struct sysfs_attr_t *attr, char *buff, int size)
+{
+	int n;
+
+	/* never opened */
+	if (!attr->path)
+		return -1;
+
+	if ((attr->fd < 0) && (sysfs_attr_reopen (attr) < 0))
+		goto error;
+
+	g_sysfs_syscalls++;
+	n = pread (attr->fd, buff, size - 1, 0);
+
+	/* device has been removed and maybe added back */
+	if ((n < 0) && (errno == ENODEV) && (sysfs_attr_reopen (attr) >= 0)) {
+		g_sysfs_syscalls++;
+		n = pread (attr->fd, buff, size - 1, 0);
+	}
+
+	if (n < 0)
+		goto error;
+
+	buff [n] = 0;
+	return n;
+
+error:
+	trace ("failed to read sysfs attr from %s\n", attr->path);
+	return -1;
+}
+
+int sysfs_attr_get_int (struct sysfs_attr_t *attr)
+{
+	char tmp [24];
+
+	if (sysfs_attr_read (attr, tmp, sizeof (tmp)) <= 0)
+		return -1;
+
+	return strtol (tmp, NULL, 0);
+}
+
+int sysfs_attr_write (struct sysfs_attr_t *attr, const char *value, int len)
+{
+	int n;
+
+	/* never opened */
+	if (!attr->path)
+		return -1;
+
+	if ((attr->fd < 0) && (sysfs_attr_reopen (attr) < 0))
+		goto error;
+
+	g_sysfs_syscalls++;
+	n = pwrite (attr->fd, value, len, 0);
+
+	/* device has been removed and maybe added back */
+	if ((n < 0) && (errno == ENODEV) && (sysfs_attr_reopen (attr) >= 0)) {
+		g_sysfs_syscalls++;
+		n = pwrite (attr->fd, value, len, 0);
+	}
+
+	if (n != len)
+		goto error;
+
+	return 0;
+
+error:
+	trace ("failed to write attr [%.*s] into %s\n", len, value, attr->path);
+	return -1;
+}
+
+int sysfs_attr_set_str (struct sysfs_attr_t *attr, const char *value)
+{
+	return sysfs_attr_write (attr, value, strlen (value));
+}
+
+int sysfs_attr_set_int (struct sysfs_attr_t *attr, int value)
+{
+	char tmp [12];
+	return sysfs_attr_write (attr, tmp, snprintf (tmp, sizeof (tmp), "%d", value));
+}
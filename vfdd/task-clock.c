@@ -11,17 +11,55 @@ struct task_clock_t {
 	struct task_t task;
 	const char *format;
 	const char *separator;
+	/* the separator indicator handle */
+	int separator_ind;
 	const char *display_task;
 	int separator_always;
 	int priority;
 	time_t last_time;
 	struct task_display_t *display;
+	/* 1 if the format shows anything changing more often than once a minute */
+	int seconds;
+	/* 1 if the separator is blinked by the driver */
+	int blink;
 };
 
+/* check if a strftime format contains seconds */
+static int clock_format_has_seconds (const char *format)
+{
+	const char *cur;
+
+	for (cur = format; (cur = strchr (cur, '%')) != NULL; ) {
+		cur++;
+		/* skip the alternative representation modifiers */
+		if ((*cur == 'E') || (*cur == 'O'))
+			cur++;
+		if (!*cur)
+			break;
+		if (strchr ("STrsXc+", *cur))
+			return 1;
+		cur++;
+	}
+
+	return 0;
+}
+
 static void task_clock_post_init (struct task_t *self)
 {
 	struct task_clock_t *self_clock = (struct task_clock_t *)self;
 	self_clock->display = (struct task_display_t *)task_find (self_clock->display_task);
+
+	if (self_clock->separator && self_clock->display)
+		self_clock->separator_ind = self_clock->display->find_indicator (self_clock->display,
+			self_clock->separator);
+
+	/* let the driver flash the separator every 0.5 sec, if it can */
+	if (self_clock->separator && self_clock->display)
+		self_clock->blink = (self_clock->display->set_blink (self_clock->display,
+			self_clock->separator, 1000, 500, 0) == 0);
+
+	trace ("%s: separator blinked by %s\n", self->instance,
+		self_clock->blink ? "driver" : "vfdd");
 }
 
 static void task_clock_fini (struct task_t *self)
@@ -42,10 +80,14 @@ static unsigned task_clock_run (struct task_t *self)
 
 	trace ("%s: run\n", self->instance);
 
+	if (self_clock->display)
+		self_clock->display->begin (self_clock->display);
+
+	localtime_r (&g_time.tv_sec, &tm);
+
 	if (self_clock->last_time != g_time.tv_sec) {
 		self_clock->last_time = g_time.tv_sec;
 
-		localtime_r (&g_time.tv_sec, &tm);
 		strftime (buff, sizeof (buff), self_clock->format, &tm);
 		if (self_clock->display)
 			self_clock->display->set_display (self_clock->display,
@@ -59,7 +101,17 @@ static unsigned task_clock_run (struct task_t *self)
 		int ena = self_clock->separator_always ? 1 :
 			self_clock->display->is_active (self_clock->display, self);
 		self_clock->display->set_indicator (self_clock->display, self,
-			self_clock->separator, ena && (ms < 500));
+			self_clock->separator_ind, ena && (self_clock->blink || (ms < 500)));
+	}
+
+	if (self_clock->display)
+		self_clock->display->commit (self_clock->display);
+
+	/* if the driver does the flashing, nothing changes until next minute;
+	 * during a leap second (tm_sec 60) just wait for the next second */
+	if (self_clock->blink && !self_clock->seconds) {
+		int left = (60 - tm.tm_sec) * 1000 - (int)ms;
+		return (left > 0) ? left : 1000 - ms;
 	}
 
 	/* sleep up to next half of second */
@@ -80,7 +132,7 @@ static void task_clock_display_notify (struct task_t *self, int active)
 	if (self_clock->separator && self_clock->display) {
 		int ena = self_clock->separator_always ? 1 : active;
 		self_clock->display->set_indicator (self_clock->display, self,
-			self_clock->separator, ena && (ms < 500));
+			self_clock->separator_ind, ena && (self_clock->blink || (ms < 500)));
 	}
 }
 
@@ -100,13 +152,16 @@ struct task_t *task_clock_new (const char *instance)
 	self->display_task = cfg_get_str (instance, "display", DEFAULT_DISPLAY);
 	self->separator_always = cfg_get_int (instance, "separator.always", 0);
 	self->priority = cfg_get_int (instance, "priority", DEFAULT_PRIORITY);
+	self->task.slack_ms = cfg_get_int (instance, "slack", DEFAULT_CLOCK_SLACK);
 
 	if (!*self->separator)
 		self->separator = NULL;
 
-	trace ("	format '%s' separator '%s' (always %d) priority %d display '%s'\n",
-		self->format, self->separator, self->separator_always,
-		self->priority, self->display_task);
+	self->seconds = clock_format_has_seconds (self->format);
+
+	trace ("	format '%s' (seconds %d) separator '%s' (always %d) priority %d display '%s' slack %u\n",
+		self->format, self->seconds, self->separator, self->separator_always,
+		self->priority, self->display_task, self->task.slack_ms);
 
 	return &self->task;
 }
@@ -2,33 +2,269 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <fcntl.h>
 
 #include "vfdd.h"
 #include "task.h"
 #include "task-display.h"
 
+/* number of fields we parse from /proc/diskstats */
+#define DISKSTATS_FIELDS	11
+/* the wildcard device name, stands for all physical disks */
+#define DISKSTATS_ALL		"*"
+
+/* a block device sampled from /proc/diskstats on behalf of disk tasks */
+struct diskstats_dev_t {
+	struct diskstats_dev_t *next;
+	/* device name as in /proc/diskstats, or DISKSTATS_ALL */
+	char *name;
+	/* number of disk tasks using this device */
+	int refs;
+	/* 1 if device was found in last sample */
+	int present;
+	/* the statistics from last sample */
+	long stat [DISKSTATS_FIELDS];
+};
+
+/* a device name seen in /proc/diskstats, to avoid repeated sysfs lookups */
+struct diskstats_name_t {
+	struct diskstats_name_t *next;
+	char *name;
+	/* 1 if this is a physical disk (not a partition, loop device etc) */
+	int disk;
+	/* 1 if device was found in last sample */
+	int present;
+};
+
+/* the shared /proc/diskstats sampler */
+static struct sysfs_attr_t g_diskstats_attr;
+/* g_clock at the time of last sample */
+static uint64_t g_diskstats_stamp = 0;
+/* devices subscribed to by disk tasks */
+static struct diskstats_dev_t *g_diskstats_devs = NULL;
+/* device names in the last sample, used for the wildcard device */
+static struct diskstats_name_t *g_diskstats_names = NULL;
+/* /proc/diskstats contents, grown as needed to hold the whole file */
+static char *g_diskstats_buff = NULL;
+static int g_diskstats_size = 0;
+
 struct task_disk_t {
 	struct task_t task;
 	const char *device;
+	struct diskstats_dev_t *dev;
 	int field;
 	int threshold;
 	const char *indicator;
+	/* the indicator handle */
+	int indicator_ind;
 	const char *display_task;
 	struct task_display_t *display;
 	long old_value;
 	int indicator_enabled;
 };
 
+static struct diskstats_dev_t *diskstats_subscribe (const char *device)
+{
+	struct diskstats_dev_t *dev;
+
+	if (!g_diskstats_devs)
+		sysfs_attr_open (&g_diskstats_attr, NULL, "/proc/diskstats", O_RDONLY);
+
+	for (dev = g_diskstats_devs; dev; dev = dev->next)
+		if (strcmp (dev->name, device) == 0) {
+			dev->refs++;
+			return dev;
+		}
+
+	dev = calloc (1, sizeof (struct diskstats_dev_t));
+	dev->name = strdup (device);
+	dev->refs = 1;
+	dev->next = g_diskstats_devs;
+	g_diskstats_devs = dev;
+
+	/* make sure next sample picks up the new device */
+	g_diskstats_stamp = 0;
+
+	return dev;
+}
+
+static void diskstats_unsubscribe (struct diskstats_dev_t *dev)
+{
+	struct diskstats_dev_t **cur;
+	struct diskstats_name_t *name;
+
+	if (--dev->refs > 0)
+		return;
+
+	for (cur = &g_diskstats_devs; *cur; cur = &(*cur)->next)
+		if (*cur == dev) {
+			*cur = dev->next;
+			break;
+		}
+
+	free (dev->name);
+	free (dev);
+
+	if (g_diskstats_devs)
+		return;
+
+	/* last user gone */
+	sysfs_attr_close (&g_diskstats_attr);
+	free (g_diskstats_buff);
+	g_diskstats_buff = NULL;
+	g_diskstats_size = 0;
+	while ((name = g_diskstats_names) != NULL) {
+		g_diskstats_names = name->next;
+		free (name->name);
+		free (name);
+	}
+}
+
+/* check if given block device is a physical disk */
+static int diskstats_is_disk (const char *device)
+{
+	struct diskstats_name_t *name;
+	char tmp [64];
+
+	for (name = g_diskstats_names; name; name = name->next)
+		if (strcmp (name->name, device) == 0) {
+			name->present = 1;
+			return name->disk;
+		}
+
+	/* new device, partitions and virtual block devices have no 'device' link */
+	snprintf (tmp, sizeof (tmp), "/sys/block/%s/device", device);
+
+	name = calloc (1, sizeof (struct diskstats_name_t));
+	name->name = strdup (device);
+	name->disk = (sysfs_exists (tmp) == 0);
+	name->present = 1;
+	name->next = g_diskstats_names;
+	g_diskstats_names = name;
+
+	trace ("diskstats: device '%s' is %sa disk\n", device, name->disk ? "" : "not ");
+
+	return name->disk;
+}
+
+/* forget device names missing from the last sample, e.g. unplugged disks */
+static void diskstats_prune_names ()
+{
+	struct diskstats_name_t **cur, *name;
+
+	for (cur = &g_diskstats_names; (name = *cur) != NULL; )
+		if (!name->present) {
+			trace ("diskstats: device '%s' is gone\n", name->name);
+			*cur = name->next;
+			free (name->name);
+			free (name);
+		} else
+			cur = &name->next;
+}
+
+/* read all subscribed devices from /proc/diskstats, once per dispatcher round */
+static void diskstats_sample ()
+{
+	struct diskstats_dev_t *dev, *all = NULL;
+	struct diskstats_name_t *known;
+	char *line, *eol, *name, *cur;
+	long stat [DISKSTATS_FIELDS];
+	int i, n, found;
+
+	if (g_diskstats_stamp == g_clock)
+		return;
+	g_diskstats_stamp = g_clock;
+
+	for (dev = g_diskstats_devs; dev; dev = dev->next)
+		if (strcmp (dev->name, DISKSTATS_ALL) == 0) {
+			memset (dev->stat, 0, sizeof (dev->stat));
+			all = dev;
+		} else
+			dev->present = 0;
+
+	for (;;) {
+		if (!g_diskstats_buff) {
+			g_diskstats_size = g_diskstats_size ? g_diskstats_size * 2 : 16384;
+			g_diskstats_buff = malloc (g_diskstats_size);
+		}
+
+		n = sysfs_attr_read (&g_diskstats_attr, g_diskstats_buff, g_diskstats_size);
+		/* a full buffer may have cut the file short, retry with a larger one */
+		if (n < g_diskstats_size - 1)
+			break;
+
+		free (g_diskstats_buff);
+		g_diskstats_buff = NULL;
+	}
+
+	if (n <= 0) {
+		if (all)
+			all->present = 0;
+		return;
+	}
+
+	if (all)
+		all->present = 1;
+
+	for (known = g_diskstats_names; known; known = known->next)
+		known->present = 0;
+
+	for (line = g_diskstats_buff; *line; line = eol) {
+		/* never parse an incomplete line */
+		if ((eol = strchr (line, '\n')) == NULL)
+			break;
+		*eol++ = 0;
+
+		/* skip major and minor numbers, then cut out device name */
+		strtoul (line, &cur, 10);
+		strtoul (cur, &cur, 10);
+		name = cur + strspn (cur, g_spaces);
+		cur = name + strcspn (name, g_spaces);
+		if (!*cur)
+			continue;
+		*cur++ = 0;
+
+		found = (all && diskstats_is_disk (name));
+		for (dev = g_diskstats_devs; dev; dev = dev->next)
+			if ((dev != all) && (strcmp (dev->name, name) == 0))
+				found = 1;
+
+		if (!found)
+			continue;
+
+		for (i = 0; i < DISKSTATS_FIELDS; i++)
+			stat [i] = strtol (cur, &cur, 10);
+
+		for (dev = g_diskstats_devs; dev; dev = dev->next)
+			if (dev == all) {
+				if (diskstats_is_disk (name))
+					for (i = 0; i < DISKSTATS_FIELDS; i++)
+						all->stat [i] += stat [i];
+			} else if (strcmp (dev->name, name) == 0) {
+				memcpy (dev->stat, stat, sizeof (stat));
+				dev->present = 1;
+			}
+	}
+
+	diskstats_prune_names ();
+}
+
 static void task_disk_post_init (struct task_t *self)
 {
 	struct task_disk_t *self_disk = (struct task_disk_t *)self;
 	self_disk->display = (struct task_display_t *)task_find (self_disk->display_task);
+
+	if (self_disk->display)
+		self_disk->indicator_ind = self_disk->display->find_indicator (self_disk->display,
+			self_disk->indicator);
 }
 
 static void task_disk_fini (struct task_t *self)
 {
 	struct task_disk_t *self_disk = (struct task_disk_t *)self;
 
+	if (self_disk->dev)
+		diskstats_unsubscribe (self_disk->dev);
 	task_fini (&self_disk->task);
 
 	free (self_disk);
@@ -37,9 +273,7 @@ static void task_disk_fini (struct task_t *self)
 static unsigned task_disk_run (struct task_t *self)
 {
 	struct task_disk_t *self_disk = (struct task_disk_t *)self;
-	char buff [50];
-	char *tmp;
-	long stat [11];
+	long *stat;
 	int enable = 0;
 
 	if (!self_disk->display)
@@ -47,22 +281,20 @@ static unsigned task_disk_run (struct task_t *self)
 
 	trace ("%s: run\n", self->instance);
 
-	snprintf (buff, sizeof (buff), "/sys/block/%s/stat", self_disk->device);
-	tmp = sysfs_read (buff);
-	if (tmp == NULL)
+	diskstats_sample ();
+	if (!self_disk->dev->present)
 		return 10000;
 
-	sscanf (tmp, "%ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld",
-		&stat [0], &stat [1], &stat [2], &stat [3], 
-		&stat [4], &stat [5], &stat [6], &stat [7], 
-		&stat [8], &stat [9], &stat [10]);
-
-	free (tmp);
+	stat = self_disk->dev->stat;
 
 	if (self_disk->old_value != -1) {
 		long delta = stat [self_disk->field] - self_disk->old_value;
-		if (delta < self_disk->threshold)
+		if (delta < self_disk->threshold) {
+			/* the sum over all disks drops when one is removed, start over */
+			if (delta < 0)
+				self_disk->old_value = stat [self_disk->field];
 			goto setind;
+		}
 
 		enable = 1;
 	}
@@ -73,7 +305,7 @@ setind:
 	if (self_disk->indicator_enabled != enable) {
 		self_disk->indicator_enabled = enable;
 		self_disk->display->set_indicator (self_disk->display, self,
-			self_disk->indicator, enable);
+			self_disk->indicator_ind, enable);
 	}
 
 	return 250;
@@ -94,20 +326,23 @@ struct task_t *task_disk_new (const char *instance)
 	self->field = cfg_get_int (instance, "field", DEFAULT_DISK_FIELD);
 	self->threshold = cfg_get_int (instance, "threshold", DEFAULT_DISK_THRESHOLD);
 	self->indicator = cfg_get_str (instance, "indicator", DEFAULT_DISK_INDICATOR);
+	self->task.slack_ms = cfg_get_int (instance, "slack", DEFAULT_DISK_SLACK);
 	self->old_value = -1;
 	self->indicator_enabled = -1;
 
-	if ((self->field <= 0) || (self->field > 11)) {
-		fprintf (stderr, "%s: invalid field number %d, must be 1 to 11\n",
-			self->task.instance, self->field);
-		free (self);
+	if ((self->field <= 0) || (self->field > DISKSTATS_FIELDS)) {
+		fprintf (stderr, "%s: invalid field number %d, must be 1 to %d\n",
+			self->task.instance, self->field, DISKSTATS_FIELDS);
+		task_disk_fini (&self->task);
 		return NULL;
 	}
 
-	trace ("	device '%s' field %d threshold %d indicator '%s'\n",
-		self->device, self->field, self->threshold, self->indicator);
+	trace ("	device '%s' field %d threshold %d indicator '%s' slack %u\n",
+		self->device, self->field, self->threshold, self->indicator, self->task.slack_ms);
 
 	self->field--;
 
+	self->dev = diskstats_subscribe (self->device);
+
 	return &self->task;
 }
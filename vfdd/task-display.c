@@ -2,15 +2,94 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
 
 #include "vfdd.h"
 #include "task-display.h"
 
-static void task_display_update (struct task_display_t *self);
+/* the stride of a priority 1 user */
+#define STRIDE1			(1ULL << 32)
 
-static int task_display_qualify (struct display_user_t *user)
+static void task_display_flush (struct task_display_t *self);
+
+/* mark some attributes dirty and schedule a flush at the end of the batch */
+static void task_display_touch (struct task_display_t *self, unsigned dirty)
+{
+	self->dirty |= dirty;
+	if (self->batch == 0)
+		task_attention (&self->task);
+}
+
+static void heap_set (struct task_display_t *self, int idx, struct display_user_t *user)
+{
+	self->heap [idx] = user;
+	user->heap_index = idx;
+}
+
+/* move the user at given heap index up, towards smaller passes */
+static void heap_sift_up (struct task_display_t *self, int idx)
+{
+	struct display_user_t *user = self->heap [idx];
+
+	while (idx > 0) {
+		int parent = (idx - 1) / 2;
+		if (self->heap [parent]->pass <= user->pass)
+			break;
+		heap_set (self, idx, self->heap [parent]);
+		idx = parent;
+	}
+
+	heap_set (self, idx, user);
+}
+
+/* move the user at given heap index down, towards larger passes */
+static void heap_sift_down (struct task_display_t *self, int idx)
+{
+	struct display_user_t *user = self->heap [idx];
+
+	for (;;) {
+		int child = 2 * idx + 1;
+		if (child >= self->heap_size)
+			break;
+		if ((child + 1 < self->heap_size) &&
+		    (self->heap [child + 1]->pass < self->heap [child]->pass))
+			child++;
+		if (user->pass <= self->heap [child]->pass)
+			break;
+		heap_set (self, idx, self->heap [child]);
+		idx = child;
+	}
+
+	heap_set (self, idx, user);
+}
+
+/* a user got a text, it joins the queue one stride after current virtual time */
+static void heap_insert (struct task_display_t *self, struct display_user_t *user)
 {
-	return (user != NULL) && (user->display != NULL);
+	user->pass = self->vtime + user->stride;
+
+	if (self->heap_size == self->heap_alloc) {
+		self->heap_alloc = self->heap_alloc ? self->heap_alloc * 2 : 8;
+		self->heap = realloc (self->heap, self->heap_alloc * sizeof (struct display_user_t *));
+	}
+	heap_set (self, self->heap_size++, user);
+	heap_sift_up (self, user->heap_index);
+}
+
+static void heap_remove (struct task_display_t *self, struct display_user_t *user)
+{
+	int idx = user->heap_index;
+
+	if (idx < 0)
+		return;
+
+	user->heap_index = -1;
+	if (idx == --self->heap_size)
+		return;
+
+	heap_set (self, idx, self->heap [self->heap_size]);
+	heap_sift_up (self, idx);
+	heap_sift_down (self, self->heap [idx]->heap_index);
 }
 
 static void task_display_set_active (struct task_display_t *self, struct display_user_t *user)
@@ -26,72 +105,66 @@ static void task_display_set_active (struct task_display_t *self, struct display
 		cur->task->display_notify (cur->task, 0);
 
 	self->active_user = user;
-	self->task.attention = 1;
+	task_display_touch (self, DIRTY_TEXT);
 
 	if (user && user->task->display_notify)
 		user->task->display_notify (user->task, 1);
 }
 
+/* give the next turn to the user with the smallest pass and charge it for the turn */
 static void task_display_next (struct task_display_t *self)
 {
-	struct display_user_t *user, *next;
-	int find_next = 1;
-	int pass;
+	struct display_user_t *next = NULL;
 
 	/* if active task has max priority, don't switch away */
 	if (self->active_user && self->active_user->priority == PRIORITY_MAX)
 		return;
 
-	next = self->active_user;
-
-	/* switch display to next task with a non-NULL display string */
-	for (pass = 0; find_next && (pass < 2); pass++) {
-		/* if there's no active display user, just start from beginning */
-		if (!next)
-			if (task_display_qualify (next = self->users))
-				find_next = 0;
-
-		for (user = self->users; find_next && user; user = user->next) {
-			if (next == user) {
-				if (user->next)
-					next = user->next;
-				else
-					next = self->users;
-
-				if (task_display_qualify (next))
-					find_next = 0;
-			}
-		}
+	if (self->heap_size) {
+		next = self->heap [0];
+		self->vtime = next->pass;
+		next->pass += next->stride;
+		heap_sift_down (self, 0);
 	}
 
-	if (find_next)
-		next = NULL;
-
 	task_display_set_active (self, next);
 }
 
+/* users share the display only while there are at least two of them */
+static void task_display_check_rotation (struct task_display_t *self)
+{
+	if (self->rotating != (self->heap_size > 1))
+		task_attention (&self->task);
+}
+
 static unsigned task_display_run (struct task_t *self)
 {
 	struct task_display_t *self_display = (struct task_display_t *)self;
-	struct display_user_t *user;
-	unsigned adj, sleep_time;
+	int rotating = self_display->heap_size > 1;
+	unsigned next;
 
-	trace ("%s: run (%u) due to %s\n", self->instance, self->sleep_ms,
-		(self->sleep_ms == 0) ? "timeout" : "attention request");
+	trace ("%s: run due to %s\n", self->instance,
+		task_due (self) ? "timeout" : "attention request");
 
-	/* if time slot ended, switch to next display user */
-	if (self->sleep_ms == 0)
-		task_display_next (self_display);
+	// a turn lasts till the nearest time quantum boundary
+	next = rotating ? self_display->quantum - (g_time.tv_usec / 1000) % self_display->quantum :
+		TASK_NEVER;
 
-	if (!(user = self_display->active_user))
-		return 1000000;
-
-	task_display_update (self_display);
+	/* if time slot ended, switch to next display user, the changes
+	 * will be written after all tasks due this round have run */
+	if (task_due (self)) {
+		task_display_next (self_display);
+		task_attention (self);
+	} else {
+		if (self_display->batch == 0)
+			task_display_flush (self_display);
+		/* a second user joined or the last but one left */
+		if (self_display->rotating != rotating)
+			task_rearm (self, next);
+	}
 
-	sleep_time = (self_display->quantum * user->priority) / self_display->min_priority;
-	// adjust sleep_time to nearest time quantum boundary
-	adj = (g_time.tv_usec / 1000) % self_display->quantum;
-	return sleep_time > adj ? sleep_time - adj : self_display->quantum - adj;
+	self_display->rotating = rotating;
+	return next;
 }
 
 static struct display_user_t *task_display_get_user (struct task_display_t *self, struct task_t *source)
@@ -106,6 +179,7 @@ static struct display_user_t *task_display_get_user (struct task_display_t *self
 	/* no display user structure, allocate a new one */
 	user = calloc (1, sizeof (struct display_user_t));
 	user->task = source;
+	user->heap_index = -1;
 	user->next = self->users;
 	self->users = user;
 
@@ -120,74 +194,136 @@ static void task_display_remove_user (struct task_display_t *self, struct task_t
 	for (cur = &self->users; *cur; cur = &(*cur)->next) {
 		if ((*cur)->task == source) {
 			struct display_user_t *user = *cur;
-			if (user->display)
-				free (user->display);
-			/* remove cur from list */
-			next = user->next;
-			free (user);
-			*cur = next;
+
+			heap_remove (self, user);
+			task_display_check_rotation (self);
 
 			/* if we're removing the active display user, switch to next */
 			if (self->active_user == user) {
-				self->active_user = next;
-				self->task.attention = 1;
+				self->active_user = NULL;
+				task_display_next (self);
+				task_display_touch (self, DIRTY_TEXT);
 			}
 
+			if (user->dotled)
+				task_display_touch (self, DIRTY_OVERLAY);
+
+			/* remove cur from list */
+			next = user->next;
+			free (user);
+			*cur = next;
+
 			return;
 		}
 	}
 }
 
-static void task_display_update (struct task_display_t *self)
+/* write a frame with the fields marked in frame_flags */
+static void task_display_write_frame (struct task_display_t *self, unsigned frame_flags)
 {
-	struct display_user_t *user;
-	const char *text = NULL;
-	unsigned dotled = 0;
+	struct display_frame_t frame;
 	unsigned i;
 
-	if ((user = self->active_user) != NULL)
-		text = user->display;
-
-	if (!text)
-		text = "";
+	memset (&frame, 0, sizeof (frame));
+	frame.flags = frame_flags;
+	frame.brightness = self->shown_brightness;
+	/* not zero-terminated if it fills the whole frame */
+	memcpy (frame.text, self->shown_text, strnlen (self->shown_text, FRAME_WORDS));
+	for (i = 0; (i < self->overlay_len) && (i < FRAME_WORDS); i++)
+		frame.overlay [i] = self->overlay [i];
 
-	trace ("%s: show [%s]\n", self->task.instance, text);
-	sysfs_set_str (self->device, "display", text);
+	trace ("%s: frame flags %x\n", self->task.instance, frame_flags);
+	sysfs_attr_write (&self->frame_attr, (const char *)&frame, sizeof (frame));
+}
 
-	/* dotled is a logical OR of all display tasks */
-	for (user = self->users; user; user = user->next)
-		dotled |= user->dotled;
+/* write dirty attributes to the device, if they really changed */
+static void task_display_flush (struct task_display_t *self)
+{
+	struct display_user_t *user;
+	const char *text = "";
+	unsigned dotled = 0;
+	unsigned frame_flags = 0;
+	unsigned i;
+	int len;
+
+	if (self->dirty & DIRTY_TEXT) {
+		if ((user = self->active_user) != NULL)
+			text = user->display;
+
+		/* longer texts are cut, so what's written is exactly what's compared */
+		len = strnlen (text, DISPLAY_TEXT_MAX);
+		if ((len != self->shown_len) || (memcmp (text, self->shown_text, len) != 0)) {
+			memcpy (self->shown_text, text, len);
+			self->shown_text [len] = 0;
+			self->shown_len = len;
+			trace ("%s: show [%s]\n", self->task.instance, self->shown_text);
+			/* strings too long for a frame are scrolled by the driver */
+			if (self->use_frame && (len <= FRAME_WORDS))
+				frame_flags |= FRAME_TEXT;
+			else
+				/* sysfs drops empty writes, a blank clears the display as well */
+				sysfs_attr_set_str (&self->display_attr, len ? self->shown_text : " ");
+		}
+	}
 
-	int dotled_changed = 0;
-	for (i = 0; i < self->indicator_count; i++) {
-		struct indicator_t *ind = &self->indicators [i];
-		unsigned mask = 1 << i;
-		unsigned need_mask = ind->mask;
-
-		if ((dotled & mask) == 0)
-			need_mask = 0;
-		if ((self->overlay [ind->word] & ind->mask) != need_mask) {
-			self->overlay [ind->word] = (self->overlay [ind->word] & ~ind->mask) | need_mask;
-			dotled_changed = 1;
+	if (self->dirty & DIRTY_BRIGHTNESS) {
+		int raw_value = (self->brightness * self->brightness_max + 50) / 100;
+		if (raw_value != self->shown_brightness) {
+			trace ("%s: brightness %d\n", self->task.instance, raw_value);
+			self->shown_brightness = raw_value;
+			if (self->use_frame)
+				frame_flags |= FRAME_BRIGHTNESS;
+			else
+				sysfs_attr_set_int (&self->brightness_attr, raw_value);
 		}
 	}
 
-	if (dotled_changed) {
-		for (i = 0; i < self->overlay_len; i++) {
-			snprintf (self->overlay_buff + i * 5, 5, "%04X", self->overlay [i]);
-			if (i < self->overlay_len - 1)
-				self->overlay_buff [i * 5 + 4] = ' ';
+	if (self->dirty & DIRTY_OVERLAY) {
+		/* dotled is a logical OR of all display tasks */
+		for (user = self->users; user; user = user->next)
+			dotled |= user->dotled;
+
+		int dotled_changed = !self->shown_overlay;
+		for (i = 0; i < self->indicator_count; i++) {
+			struct indicator_t *ind = &self->indicators [i];
+			unsigned mask = 1 << i;
+			unsigned need_mask = ind->mask;
+
+			if ((dotled & mask) == 0)
+				need_mask = 0;
+			if ((self->overlay [ind->word] & ind->mask) != need_mask) {
+				self->overlay [ind->word] = (self->overlay [ind->word] & ~ind->mask) | need_mask;
+				dotled_changed = 1;
+			}
 		}
 
-		trace ("%s: overlay [%s]\n", self->task.instance, self->overlay_buff);
-		sysfs_set_str (self->device, "overlay", self->overlay_buff);
+		if (dotled_changed && self->use_frame)
+			frame_flags |= FRAME_OVERLAY;
+		else if (dotled_changed && self->overlay_len && self->overlay_buff) {
+			for (i = 0; i < self->overlay_len; i++) {
+				snprintf (self->overlay_buff + i * 5, 5, "%04X", self->overlay [i]);
+				if (i < self->overlay_len - 1)
+					self->overlay_buff [i * 5 + 4] = ' ';
+			}
+
+			trace ("%s: overlay [%s]\n", self->task.instance, self->overlay_buff);
+			sysfs_attr_set_str (&self->overlay_attr, self->overlay_buff);
+		}
+		self->shown_overlay = 1;
 	}
+
+	self->dirty = 0;
+
+	/* all changes go to the device in a single atomic write */
+	if (frame_flags)
+		task_display_write_frame (self, frame_flags);
 }
 
 static void task_display_set_display (struct task_display_t *self, struct task_t *source, int priority,
 	const char *string)
 {
 	struct display_user_t *user;
+	int changed;
 
 	trace ("%s: set_display '%s' prio %d\n", self->task.instance, string, priority);
 
@@ -197,56 +333,146 @@ static void task_display_set_display (struct task_display_t *self, struct task_t
 	}
 
 	user = task_display_get_user (self, source);
-	if (user->display) {
-		free (user->display);
-		user->display = NULL;
+	changed = (user->heap_index < 0) || (strncmp (user->display, string, DISPLAY_TEXT_MAX) != 0);
+	if (changed)
+		strncpy (user->display, string, DISPLAY_TEXT_MAX);
+
+	if (user->priority != priority) {
+		uint64_t stride = STRIDE1 / priority;
+
+		/* keep the share of the current round already waited for */
+		if ((user->heap_index >= 0) && (user->pass > self->vtime)) {
+			user->pass = self->vtime + (user->pass - self->vtime) * user->priority / priority;
+			heap_sift_up (self, user->heap_index);
+			heap_sift_down (self, user->heap_index);
+		}
+
+		user->priority = priority;
+		user->stride = stride;
 	}
 
-	user->display = strdup (string);
-	user->priority = priority;
-	if (self->min_priority > priority)
-		self->min_priority = priority;
+	if (user->heap_index < 0) {
+		heap_insert (self, user);
+		task_display_check_rotation (self);
+	}
 
 	if (priority == PRIORITY_MAX)
 		task_display_set_active (self, user);
+	/* an idle display is given away at once */
+	else if (!self->active_user)
+		task_display_next (self);
 
-	if (self->active_user == user)
-		self->task.attention = 1;
+	if (changed && (self->active_user == user))
+		task_display_touch (self, DIRTY_TEXT);
 }
 
 static void task_display_set_indicator (struct task_display_t *self, struct task_t *source,
-	const char *indicator, int enable)
+	int indicator, int enable)
 {
-	int i;
 	struct display_user_t *user;
+	unsigned dotled;
+
+	if ((indicator < 0) || (indicator >= self->indicator_count))
+		return;
 
 	trace ("%s: %s set_indicator '%s' %s\n", self->task.instance, source->instance,
-		indicator, enable ? "on" : "off");
+		self->indicators [indicator].name, enable ? "on" : "off");
 
 	user = task_display_get_user (self, source);
 
+	dotled = user->dotled;
+	if (enable != 0)
+		dotled |= (1 << indicator);
+	else
+		dotled &= ~(1 << indicator);
+
+	if (dotled != user->dotled) {
+		user->dotled = dotled;
+		task_display_touch (self, DIRTY_OVERLAY);
+	}
+}
+
+static int task_display_find_indicator (struct task_display_t *self, const char *name)
+{
+	int i;
+
+	for (i = 0; i < self->indicator_count; i++)
+		if (strcmp (name, self->indicators [i].name) == 0)
+			return i;
+
+	trace ("%s: no indicator named '%s'\n", self->task.instance, name);
+	return -1;
+}
+
+static int task_display_set_blink (struct task_display_t *self, const char *indicator,
+	int period, int duty, int phase)
+{
+	char tmp [64];
+	int i;
+
+	trace ("%s: set_blink '%s' period %d duty %d phase %d\n", self->task.instance,
+		indicator, period, duty, phase);
+
+	if (!self->use_blink)
+		return -1;
+
 	for (i = 0; i < self->indicator_count; i++) {
 		struct indicator_t *ind = &self->indicators [i];
 		if (strcmp (indicator, ind->name) == 0) {
-			if (enable != 0)
-				user->dotled |= (1 << i);
-			else
-				user->dotled &= ~(1 << i);
-
-			if (self->active_user == user)
-				self->task.attention = 1;
+			snprintf (tmp, sizeof (tmp), "%s %d %d %d", ind->name, period, duty, phase);
+			if (sysfs_attr_set_str (&self->blink_attr, tmp) != 0)
+				return -1;
 
-			return;
+			ind->blinking = (period != 0);
+			return 0;
 		}
 	}
 
 	trace ("%s: no indicator named '%s'\n", self->task.instance, indicator);
+	return -1;
 }
 
-static void task_display_set_brightness (struct task_display_t *self, int value)
+static int task_display_set_power_frame (struct task_display_t *self, int shutdown,
+	const char *text, const char *indicators, int brightness)
 {
-	int raw_value;
+	struct display_frame_t frame;
+	struct sysfs_attr_t attr;
+	char *names, *name, *saveptr;
+	int i, ret;
+
+	trace ("%s: set_power_frame %s '%s' indicators '%s' brightness %d\n", self->task.instance,
+		shutdown ? "shutdown" : "suspend", text, indicators, brightness);
+
+	memset (&frame, 0, sizeof (frame));
+	frame.flags = FRAME_TEXT | FRAME_OVERLAY | FRAME_BRIGHTNESS;
+	frame.brightness = (brightness * self->brightness_max + 50) / 100;
+	memcpy (frame.text, text, strnlen (text, FRAME_WORDS));
+
+	names = strdup (indicators);
+	for (name = strtok_r (names, g_spaces, &saveptr); name;
+	     name = strtok_r (NULL, g_spaces, &saveptr)) {
+		for (i = 0; i < self->indicator_count; i++)
+			if (strcmp (name, self->indicators [i].name) == 0)
+				break;
+
+		if ((i < self->indicator_count) && (self->indicators [i].word < FRAME_WORDS))
+			frame.overlay [self->indicators [i].word] |= self->indicators [i].mask;
+		else
+			trace ("%s: no indicator named '%s'\n", self->task.instance, name);
+	}
+	free (names);
+
+	/* written once, no need to keep it open */
+	ret = sysfs_attr_open (&attr, self->device, shutdown ? "shutdown_frame" : "suspend_frame", O_WRONLY);
+	if (ret == 0)
+		ret = sysfs_attr_write (&attr, (const char *)&frame, sizeof (frame));
+	sysfs_attr_close (&attr);
 
+	return ret;
+}
+
+static void task_display_set_brightness (struct task_display_t *self, int value)
+{
 	if (value < 0)
 		value = 0;
 	else if (value > 100)
@@ -255,8 +481,18 @@ static void task_display_set_brightness (struct task_display_t *self, int value)
 	trace ("%s: set_brightness %d\n", self->task.instance, value);
 
 	self->brightness = value;
-	raw_value = (value * self->brightness_max + 50) / 100;
-	sysfs_set_int (self->device, "brightness", raw_value);
+	task_display_touch (self, DIRTY_BRIGHTNESS);
+}
+
+static void task_display_begin (struct task_display_t *self)
+{
+	self->batch++;
+}
+
+static void task_display_commit (struct task_display_t *self)
+{
+	if ((--self->batch == 0) && self->dirty)
+		task_attention (&self->task);
 }
 
 static int task_display_is_active (struct task_display_t *self, struct task_t *source)
@@ -279,22 +515,39 @@ static void task_display_fini (struct task_t *self)
 	/* free display users */
 	for (user = &self_display->users; *user; ) {
 		struct display_user_t *next = (*user)->next;
-		free ((*user)->display);
 		free (*user);
 		*user = next;
 	}
-
-	/* update display (effectively clear) */
-	task_display_update (self_display);
+	free (self_display->heap);
+	self_display->heap_size = 0;
+
+	/* update display (effectively clear), unless construction was aborted */
+	if (self_display->overlay_buff) {
+		self_display->batch = 0;
+		self_display->dirty |= DIRTY_TEXT | DIRTY_OVERLAY;
+		task_display_flush (self_display);
+	}
 
 	if (self_display->indicators) {
-		for (i = 0; i < self_display->indicator_count; i++)
+		for (i = 0; i < self_display->indicator_count; i++) {
+			/* don't leave the driver blinking after we're gone */
+			if (self_display->indicators [i].blinking)
+				task_display_set_blink (self_display, self_display->indicators [i].name, 0, 0, 0);
 			free (self_display->indicators [i].name);
+		}
 		free (self_display->indicators);
 	}
 
 	if (self_display->overlay)
 		free (self_display->overlay);
+	if (self_display->overlay_buff)
+		free (self_display->overlay_buff);
+
+	sysfs_attr_close (&self_display->display_attr);
+	sysfs_attr_close (&self_display->overlay_attr);
+	sysfs_attr_close (&self_display->brightness_attr);
+	sysfs_attr_close (&self_display->frame_attr);
+	sysfs_attr_close (&self_display->blink_attr);
 
 	task_fini (&self_display->task);
 
@@ -308,14 +561,20 @@ struct task_t *task_display_new (const char *instance)
 
 	task_init (&self->task, instance);
 
-	self->min_priority = 1000000;
-
 	self->task.run = task_display_run;
 	self->task.fini = task_display_fini;
 	self->set_display = task_display_set_display;
 	self->set_indicator = task_display_set_indicator;
+	self->find_indicator = task_display_find_indicator;
+	self->set_blink = task_display_set_blink;
+	self->set_power_frame = task_display_set_power_frame;
 	self->set_brightness = task_display_set_brightness;
 	self->is_active = task_display_is_active;
+	self->begin = task_display_begin;
+	self->commit = task_display_commit;
+	self->shown_brightness = -1;
+	/* force the first write, even of an empty text */
+	self->shown_len = -1;
 
 	self->device = cfg_get_str (instance, "device", DEFAULT_DEVICE);
 	if (sysfs_exists (self->device) != 0) {
@@ -327,8 +586,28 @@ struct task_t *task_display_new (const char *instance)
 
 	self->brightness = cfg_get_int (instance, "brightness", DEFAULT_BRIGHTNESS);
 	self->quantum = cfg_get_int (instance, "quantum", DEFAULT_DISPLAY_QUANTUM);
-	trace ("	device [%s] brightness %d quantum %d\n",
-		self->device, self->brightness, self->quantum);
+	self->task.slack_ms = cfg_get_int (instance, "slack", DEFAULT_DISPLAY_SLACK);
+	trace ("	device [%s] brightness %d quantum %d slack %u\n",
+		self->device, self->brightness, self->quantum, self->task.slack_ms);
+
+	/* prefer the atomic frame attribute, fall back to separate attributes on older drivers;
+	 * display is needed anyway for strings that don't fit in a frame */
+	sysfs_attr_open (&self->display_attr, self->device, "display", O_WRONLY);
+	if (sysfs_attr_open (&self->frame_attr, self->device, "frame", O_WRONLY) == 0)
+		self->use_frame = 1;
+	else {
+		sysfs_attr_close (&self->frame_attr);
+		sysfs_attr_open (&self->overlay_attr, self->device, "overlay", O_WRONLY);
+		sysfs_attr_open (&self->brightness_attr, self->device, "brightness", O_WRONLY);
+	}
+	trace ("	using %s\n", self->use_frame ? "frame attribute" : "separate attributes");
+
+	/* older drivers can't blink by themselves */
+	if (sysfs_attr_open (&self->blink_attr, self->device, "blink", O_WRONLY) == 0)
+		self->use_blink = 1;
+	else
+		sysfs_attr_close (&self->blink_attr);
+	trace ("	driver blinking %s\n", self->use_blink ? "supported" : "not supported");
 
 	/* detect available dot LED indicators */
 	tmp = (char *)sysfs_get_str (self->device, "dotled");
@@ -361,11 +640,15 @@ struct task_t *task_display_new (const char *instance)
 				break;
 			cur++;
 		}
+
+		free (tmp);
 	}
 
 	/* initialize overlay */
 	self->overlay = calloc (self->overlay_len, sizeof (uint16_t));
-	self->overlay_buff = malloc (self->overlay_len * 5);
+	self->overlay_buff = malloc (self->overlay_len * 5 + 1);
+	self->overlay_buff [0] = 0;
+	self->dirty = DIRTY_TEXT | DIRTY_OVERLAY;
 
 	/* get max brightness */
 	self->brightness_max = sysfs_get_int (self->device, "brightness_max");
@@ -5,34 +5,74 @@
 #ifndef __TASK_DISPLAY_H__
 #define __TASK_DISPLAY_H__
 
+#include "vfdd.h"
 #include "task.h"
 
 #define PRIORITY_MAX		1000000
+/* max length of the text shown on display, the driver scrolls up to 64 */
+#define DISPLAY_TEXT_MAX	64
+
+/* bits in task_display_t.dirty */
+#define DIRTY_TEXT		0x01
+#define DIRTY_OVERLAY		0x02
+#define DIRTY_BRIGHTNESS	0x04
+
+/* the binary "frame" attribute layout, must match struct vfd_frame_t in vfd-ioctl.h */
+#define FRAME_WORDS		8
+
+#define FRAME_TEXT		0x01
+#define FRAME_OVERLAY		0x02
+#define FRAME_BRIGHTNESS	0x04
+
+struct display_frame_t {
+	uint8_t flags;
+	uint8_t brightness;
+	char text [FRAME_WORDS];
+	uint16_t overlay [FRAME_WORDS];
+};
 
 struct display_user_t {
 	struct display_user_t *next;
 	struct task_t *task;
 	int priority;
-	char *display;
+	/* the text to show, valid while the user is in the heap */
+	char display [DISPLAY_TEXT_MAX + 1];
 	uint16_t dotled;
+	/* stride scheduling: the virtual time of the next turn and its increment */
+	uint64_t pass;
+	uint64_t stride;
+	/* position in the display task's heap, -1 if not there (no text) */
+	int heap_index;
 };
 
 struct indicator_t {
 	char *name;
 	int word;
 	unsigned mask;
+	/* 1 if the driver has been asked to blink this indicator */
+	int blinking;
 };
 
 struct task_display_t {
 	struct task_t task;
 
 	const char *device;
+	/* display, overlay and brightness attributes of the device */
+	struct sysfs_attr_t display_attr;
+	struct sysfs_attr_t overlay_attr;
+	struct sysfs_attr_t brightness_attr;
+	/* the combined frame attribute, if supported by the driver */
+	struct sysfs_attr_t frame_attr;
+	/* 1 if all changes are written through frame_attr */
+	int use_frame;
+	/* the blink attribute, if the driver can blink by itself */
+	struct sysfs_attr_t blink_attr;
+	int use_blink;
 	struct indicator_t *indicators;
 	int indicator_count;
 	int brightness;
 	int brightness_max;
 	int quantum;
-	int min_priority;
 
 	uint16_t *overlay;
 	int overlay_len;
@@ -41,6 +81,28 @@ struct task_display_t {
 	struct display_user_t *users;
 	/* the display user currently owning the display */
 	struct display_user_t *active_user;
+	/* binary min-heap of users with a text, ordered by pass */
+	struct display_user_t **heap;
+	int heap_size;
+	/* allocated heap entries, the heap never shrinks */
+	int heap_alloc;
+	/* the pass of the last user given a turn */
+	uint64_t vtime;
+	/* non-zero while the task wakes up every quantum to switch users */
+	int rotating;
+
+	/* a combination of DIRTY_XXX bits for attributes that may need a rewrite */
+	unsigned dirty;
+	/* begin()/commit() nesting level */
+	int batch;
+	/* the text last written to the device */
+	char shown_text [DISPLAY_TEXT_MAX + 1];
+	/* the length of shown_text, -1 if nothing written yet */
+	int shown_len;
+	/* 0 until the overlay has been written once */
+	int shown_overlay;
+	/* the brightness last written to the device, -1 if unknown */
+	int shown_brightness;
 
 	/**
 	 * Display a string on behalf of given task.
@@ -54,9 +116,10 @@ struct task_display_t {
 	 *      associated with this task
 	 * @arg priority
 	 *      text priority. the normal priority is 100, use larger or smaller
-	 *      values if you need larger or smaller priority. For example, if a
-	 *      task displays with prio=100 and another with prio=10, first task
-	 *      will be displayed for 'quantum' ms and secnd for 'quantum*100/10' ms.
+	 *      values if you need larger or smaller priority. The display is given
+	 *      away in turns of 'quantum' ms, for example, if a task displays with
+	 *      prio=100 and another with prio=10, first task gets 10 turns for
+	 *      every turn of the second.
 	 * @arg string
 	 *      the string to display. if NULL, the text associated with 'source' is
 	 *      deleted.
@@ -72,12 +135,57 @@ struct task_display_t {
 	 *      the task owning the icon. The icon is turned off if the task passes away,
 	 *      and all active icons from all tasks are lighted up at the same time.
 	 * @arg indicator
-	 *	the name of the indicator
+	 *	the indicator handle returned by find_indicator()
 	 * @arg enable
 	 *	0 to disable the indicator, 1 to enable
 	 */
 	void (*set_indicator) (struct task_display_t *self, struct task_t *source,
-		const char *indicator, int enable);
+		int indicator, int enable);
+
+	/**
+	 * Look up an indicator by name, so that set_indicator() doesn't have to.
+	 * @arg self
+	 *	the display task
+	 * @arg name
+	 *	the name of the indicator
+	 * @return
+	 *	the indicator handle, or -1 if there's no such indicator
+	 */
+	int (*find_indicator) (struct task_display_t *self, const char *name);
+
+	/**
+	 * Let the driver blink an indicator by itself, in sync with the wall
+	 * clock: the indicator (if enabled with set_indicator) is lit for the
+	 * first 'duty' ms of every 'period' ms, periods starting 'phase' ms
+	 * after the Unix epoch. A zero period stops blinking.
+	 * @arg self
+	 *	the display task
+	 * @arg indicator
+	 *	the name of the indicator
+	 * @return
+	 *	0 on success, -1 if the driver can't blink or there's no such indicator
+	 */
+	int (*set_blink) (struct task_display_t *self, const char *indicator,
+		int period, int duty, int phase);
+
+	/**
+	 * Preload the frame the driver shows by itself on suspend or shutdown,
+	 * when userspace can't do anything anymore.
+	 * @arg self
+	 *	the display task
+	 * @arg shutdown
+	 *	0 for the suspend frame, 1 for the shutdown frame
+	 * @arg text
+	 *	the text to show
+	 * @arg indicators
+	 *	space-separated names of the indicators to light
+	 * @arg brightness
+	 *	display brightness (0-100%)
+	 * @return
+	 *	0 on success, -1 if the driver doesn't support this
+	 */
+	int (*set_power_frame) (struct task_display_t *self, int shutdown, const char *text,
+		const char *indicators, int brightness);
 
 	/**
 	 * Change display brightness
@@ -88,6 +196,23 @@ struct task_display_t {
 	 */
 	void (*set_brightness) (struct task_display_t *self, int value);
 
+	/**
+	 * Start a batch of display changes. Changes are written to the device
+	 * only after the outermost commit(), at most once per attribute, at the
+	 * end of current dispatcher round. Changes made outside of a batch are
+	 * also written at the end of current dispatcher round.
+	 * @arg self
+	 *	the display task
+	 */
+	void (*begin) (struct task_display_t *self);
+
+	/**
+	 * Finish a batch of display changes started with begin().
+	 * @arg self
+	 *	the display task
+	 */
+	void (*commit) (struct task_display_t *self);
+
 	/**
 	 * Check if given task is currently active.
 	 * @arg source
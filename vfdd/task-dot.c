@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <fcntl.h>
 
 #include "vfdd.h"
 #include "task.h"
@@ -10,8 +11,11 @@
 struct task_dot_t {
 	struct task_t task;
 	const char *attr;
+	struct sysfs_attr_t attr_handle;
 	const char *display_task;
 	const char *indicator;
+	/* the indicator handle */
+	int indicator_ind;
 	int field;
 	int threshold;
 	int priority;
@@ -25,12 +29,17 @@ static void task_dot_post_init (struct task_t *self)
 {
 	struct task_dot_t *self_dot = (struct task_dot_t *)self;
 	self_dot->display = (struct task_display_t *)task_find (self_dot->display_task);
+
+	if (self_dot->display)
+		self_dot->indicator_ind = self_dot->display->find_indicator (self_dot->display,
+			self_dot->indicator);
 }
 
 static void task_dot_fini (struct task_t *self)
 {
 	struct task_dot_t *self_dot = (struct task_dot_t *)self;
 
+	sysfs_attr_close (&self_dot->attr_handle);
 	task_fini (&self_dot->task);
 
 	free (self_dot);
@@ -39,13 +48,12 @@ static void task_dot_fini (struct task_t *self)
 static unsigned task_dot_run (struct task_t *self)
 {
 	struct task_dot_t *self_dot = (struct task_dot_t *)self;
-	char *tmp, *cur;
+	char tmp [256], *cur;
 	int i, val;
 
 	trace ("%s: run\n", self->instance);
 
-	tmp = sysfs_read (self_dot->attr);
-	if (tmp == NULL)
+	if (sysfs_attr_read (&self_dot->attr_handle, tmp, sizeof (tmp)) <= 0)
 		return 10000;
 
         cur = tmp + strspn (tmp, whitespace);
@@ -58,13 +66,12 @@ static unsigned task_dot_run (struct task_t *self)
         }
 
 	val = strtol (cur, NULL, 0);
-	free (tmp);
 
         val = (val >= self_dot->threshold) ? 1 : 0;
 	if (self_dot->display && (val != self_dot->indicator_enabled)) {
 		self_dot->indicator_enabled = val;
 		self_dot->display->set_indicator (self_dot->display, self,
-			self_dot->indicator, val);
+			self_dot->indicator_ind, val);
 	}
 
 	return 500;
@@ -86,12 +93,16 @@ struct task_t *task_dot_new (const char *instance)
 	self->threshold = cfg_get_int (instance, "threshold", DEFAULT_DOT_THRESHOLD);
 	self->indicator = cfg_get_str (instance, "indicator", DEFAULT_DOT_INDICATOR);
 	self->priority = cfg_get_int (instance, "priority", DEFAULT_PRIORITY);
+	self->task.slack_ms = cfg_get_int (instance, "slack", DEFAULT_DOT_SLACK);
 
 	// force indicator refresh
 	self->indicator_enabled = -1;
 
-	trace ("	if attr '%s'.%d >= %d display '%s' indicator '%s'\n",
-		self->attr, self->field, self->threshold, self->display_task, self->indicator);
+	trace ("	if attr '%s'.%d >= %d display '%s' indicator '%s' slack %u\n",
+		self->attr, self->field, self->threshold, self->display_task, self->indicator,
+		self->task.slack_ms);
+
+	sysfs_attr_open (&self->attr_handle, NULL, self->attr, O_RDONLY);
 
 	return &self->task;
 }
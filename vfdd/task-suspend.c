@@ -8,8 +8,9 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
-#include <pthread.h>
 #include <errno.h>
+#include <limits.h>
+#include <sys/epoll.h>
 
 #include "vfdd.h"
 #include "task.h"
@@ -21,45 +22,121 @@ struct task_suspend_t {
 	const char *indicators;
 	const char *display_task;
 	int brightness;
+	const char *shutdown_text;
+	const char *shutdown_indicators;
+	int shutdown_brightness;
 	struct task_display_t *display;
+	/* handles of the indicators to light on suspend */
+	int *indicator_inds;
+	int indicator_count;
 	int uevent_sock;
-	pthread_t uevent_tid;
-	volatile uint8_t suspended;
-	volatile uint8_t shutdown;
+	/* the uevent header we're interested in, "change@<devpath>" */
+	char *uevent_header;
+	/* the suspend state currently shown */
+	int suspended;
+	/* display brightness to restore on resume */
+	int saved_brightness;
 };
 
 static int uevent_open (int buf_sz);
-static void *uevent_watching_thread (void *_self);
+static int uevent_filter (int sock, const char *header);
+static void uevent_ready (struct task_t *self, int fd, unsigned events);
 
 static void task_suspend_post_init (struct task_t *self)
 {
 	struct task_suspend_t *self_suspend = (struct task_suspend_t *)self;
+	char devpath [PATH_MAX];
+	char *names, *name, *saveptr;
+	int ind;
+
 	self_suspend->display = (struct task_display_t *)task_find (self_suspend->display_task);
-	self_suspend->shutdown = 0;
-	pthread_create (&self_suspend->uevent_tid, NULL, uevent_watching_thread, self_suspend);
+
+	if (!self_suspend->display)
+		return;
+
+	names = strdup (self_suspend->indicators);
+	for (name = strtok_r (names, g_spaces, &saveptr); name;
+	     name = strtok_r (NULL, g_spaces, &saveptr)) {
+		ind = self_suspend->display->find_indicator (self_suspend->display, name);
+		if (ind < 0)
+			continue;
+
+		self_suspend->indicator_inds = realloc (self_suspend->indicator_inds,
+			(self_suspend->indicator_count + 1) * sizeof (int));
+		self_suspend->indicator_inds [self_suspend->indicator_count++] = ind;
+	}
+	free (names);
+
+	/* newer drivers show these by themselves, no matter if we're frozen or dead */
+	if (self_suspend->display->set_power_frame (self_suspend->display, 0,
+		self_suspend->text, self_suspend->indicators, self_suspend->brightness) == 0)
+		self_suspend->display->set_power_frame (self_suspend->display, 1,
+			self_suspend->shutdown_text, self_suspend->shutdown_indicators,
+			self_suspend->shutdown_brightness);
+
+	/* uevents carry the device path relative to /sys, symlinks resolved */
+	if (!realpath (self_suspend->display->device, devpath) ||
+	    (strncmp (devpath, "/sys/", 5) != 0)) {
+		fprintf (stderr, "%s: can't find device path of '%s'\n",
+			self->instance, self_suspend->display->device);
+		return;
+	}
+
+	self_suspend->uevent_header = malloc (strlen (devpath) + 8);
+	sprintf (self_suspend->uevent_header, "change@%s", devpath + 4);
+	trace ("%s: watching uevents '%s'\n", self->instance, self_suspend->uevent_header);
+
+	/* let the kernel drop everything else, so that hotplug storms don't wake us up */
+	if (uevent_filter (self_suspend->uevent_sock, self_suspend->uevent_header) < 0)
+		fprintf (stderr, "%s: failed to attach uevent filter\n", self->instance);
+
+	task_watch_fd (self, self_suspend->uevent_sock, EPOLLIN, uevent_ready);
 }
 
 static void task_suspend_fini (struct task_t *self)
 {
 	struct task_suspend_t *self_suspend = (struct task_suspend_t *)self;
 
-	self_suspend->shutdown = 1;
 	task_fini (&self_suspend->task);
 
 	close (self_suspend->uevent_sock);
 
+	free (self_suspend->uevent_header);
+	free (self_suspend->indicator_inds);
 	free (self_suspend);
 }
 
-static unsigned task_suspend_run (struct task_t *self)
+/* show or remove the suspend text, indicators and brightness */
+static void task_suspend_show (struct task_suspend_t *self, int suspended)
 {
-	struct task_suspend_t *self_suspend = (struct task_suspend_t *)self;
+	struct task_display_t *display = self->display;
+	int i;
+
+	trace ("%s: %s\n", self->task.instance, suspended ? "suspend" : "resume");
+
+	display->begin (display);
+
+	if (suspended) {
+		self->saved_brightness = display->brightness;
+		display->set_display (display, &self->task, PRIORITY_MAX, self->text);
 
-	/* check if a uevent occured */
-	if (self_suspend->task.attention) {
+		for (i = 0; i < self->indicator_count; i++)
+			display->set_indicator (display, &self->task, self->indicator_inds [i], 1);
+
+		display->set_brightness (display, self->brightness);
+	} else {
+		/* this drops our indicators, too */
+		display->set_display (display, &self->task, 0, NULL);
+		display->set_brightness (display, self->saved_brightness);
 	}
 
-	return 10000;
+	display->commit (display);
+}
+
+static unsigned task_suspend_run (struct task_t *self)
+{
+	/* everything is done by uevent_ready() */
+	return 1000000;
 }
 
 struct task_t *task_suspend_new (const char *instance)
@@ -76,17 +153,24 @@ struct task_t *task_suspend_new (const char *instance)
 	self->text = cfg_get_str (instance, "text", DEFAULT_SUSPEND_TEXT);
 	self->indicators = cfg_get_str (instance, "indicators", DEFAULT_SUSPEND_INDICATORS);
 	self->brightness = cfg_get_int (instance, "brightness", DEFAULT_SUSPEND_BRIGHTNESS);
+	self->shutdown_text = cfg_get_str (instance, "shutdown.text", DEFAULT_SHUTDOWN_TEXT);
+	self->shutdown_indicators = cfg_get_str (instance, "shutdown.indicators", DEFAULT_SHUTDOWN_INDICATORS);
+	self->shutdown_brightness = cfg_get_int (instance, "shutdown.brightness", DEFAULT_SHUTDOWN_BRIGHTNESS);
+	self->task.slack_ms = cfg_get_int (instance, "slack", DEFAULT_SUSPEND_SLACK);
 
 	self->uevent_sock = uevent_open (16 * 1024);
 	if (self->uevent_sock < 0) {
 		fprintf (stderr, "%s: failed to open uevent socket\n",
 			self->task.instance);
+		task_fini (&self->task);
 		free (self);
 		return NULL;
 	}
 
 	trace ("	text '%s' indicators '%s' brightness %d display '%s'\n",
 		self->text, self->indicators, self->brightness, self->display_task);
+	trace ("	shutdown text '%s' indicators '%s' brightness %d\n",
+		self->shutdown_text, self->shutdown_indicators, self->shutdown_brightness);
 
 	return &self->task;
 }
@@ -95,8 +179,8 @@ struct task_t *task_suspend_new (const char *instance)
 
 #define __USE_GNU
 #include <fcntl.h>
-#include <poll.h>
 #include <linux/netlink.h>
+#include <linux/filter.h>
 #include <sys/socket.h>
 
 #ifndef SOCK_CLOEXEC
@@ -114,7 +198,8 @@ static int uevent_open (int buf_sz)
 	memset (&addr, 0, sizeof (addr));
 	addr.nl_family = AF_NETLINK;
 	addr.nl_pid = getpid ();
-	addr.nl_groups = 0xffffffff;
+	/* kernel uevents only, not the ones rebroadcast by udev */
+	addr.nl_groups = 1;
 
 	sock = socket (PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
 	if (sock < 0)
@@ -135,6 +220,81 @@ static int uevent_open (int buf_sz)
 	return sock;
 }
 
+/*
+ * Attach a classic BPF program to the uevent socket, which passes only
+ * the messages starting with given header (including the terminating
+ * zero). The header is compared 4, 2 or 1 bytes at a time, loads past
+ * the end of a message drop it.
+ */
+static int uevent_filter (int sock, const char *header)
+{
+	int len = strlen (header) + 1;
+	/* load & compare per chunk, plus accept & reject */
+	struct sock_filter code [2 * (len / 4 + 2) + 2];
+	struct sock_fprog prog;
+	int i, n, off, size;
+
+	for (n = 0, off = 0; off < len; off += size) {
+		uint32_t value = 0;
+
+		size = (len - off >= 4) ? 4 : (len - off >= 2) ? 2 : 1;
+		for (i = 0; i < size; i++)
+			value = (value << 8) | (uint8_t)header [off + i];
+
+		code [n++] = (struct sock_filter) BPF_STMT (BPF_LD | BPF_ABS |
+			((size == 4) ? BPF_W : (size == 2) ? BPF_H : BPF_B), off);
+		/* the jump to reject is fixed up below */
+		code [n++] = (struct sock_filter) BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, value, 0, 0);
+	}
+
+	code [n++] = (struct sock_filter) BPF_STMT (BPF_RET | BPF_K, 0xffffffff);
+	code [n++] = (struct sock_filter) BPF_STMT (BPF_RET | BPF_K, 0);
+
+	for (i = 1; i < n - 2; i += 2) {
+		if (n - 1 - (i + 1) > 255)
+			return -1;
+		code [i].jf = n - 1 - (i + 1);
+	}
+
+	prog.len = n;
+	prog.filter = code;
+	return setsockopt (sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof (prog));
+}
+
+/* parse a uevent message: "change@<devpath>\0KEY=VALUE\0KEY=VALUE..." */
+static void uevent_check (struct task_suspend_t *self, const char *msg, int size)
+{
+	const char *cur, *end = msg + size;
+	int len, platform = 0, suspend = -1;
+
+	/* the filter may be missing */
+	len = strnlen (msg, size);
+	if (!self->uevent_header || (len == size) || (strcmp (msg, self->uevent_header) != 0))
+		return;
+
+	for (cur = msg + len + 1; cur < end; cur += len + 1) {
+		len = strnlen (cur, end - cur);
+		/* unterminated */
+		if (cur + len == end)
+			break;
+
+		if (strcmp (cur, "SUBSYSTEM=platform") == 0)
+			platform = 1;
+		else if (strncmp (cur, "SUSPEND=", 8) == 0)
+			suspend = atoi (cur + 8);
+	}
+
+	if (!platform || (suspend < 0))
+		return;
+
+	trace ("%s: uevent SUSPEND=%d\n", self->task.instance, suspend);
+	suspend = suspend ? 1 : 0;
+	if (suspend != self->suspended) {
+		self->suspended = suspend;
+		task_suspend_show (self, suspend);
+	}
+}
+
 static void uevent_handle (struct task_suspend_t *self)
 {
 	for (;;)
@@ -178,25 +338,12 @@ static void uevent_handle (struct task_suspend_t *self)
 		if (!ucred || ucred->pid != 0 || addr.nl_pid != 0)
 			continue;
 
-		//uevent_check (msg, size);
+		uevent_check (self, msg, size);
 	}
 }
 
-static void *uevent_watching_thread (void *_self)
+/* called by the dispatcher when uevents are waiting in the socket */
+static void uevent_ready (struct task_t *self, int fd, unsigned events)
 {
-	struct task_suspend_t *self = (struct task_suspend_t *)_self;
-	struct pollfd pfd;
-	pfd.events = POLLIN;
-	pfd.fd = self->uevent_sock;
-
-	while (!self->shutdown) {
-		// wait until a new uevent comes
-		pfd.revents = 0;
-		int rc = poll (&pfd, 1, -1);
-
-		if ((rc > 0) && (pfd.revents & POLLIN))
-			uevent_handle (self);
-	}
-
-	return NULL;
+	uevent_handle ((struct task_suspend_t *)self);
 }
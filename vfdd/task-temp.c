@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <fcntl.h>
 
 #include "vfdd.h"
 #include "task.h"
@@ -10,6 +11,7 @@
 struct task_temp_t {
 	struct task_t task;
 	const char *value;
+	struct sysfs_attr_t value_attr;
 	const char *format;
 	const char *display_task;
 	int divider;
@@ -27,6 +29,7 @@ static void task_temp_fini (struct task_t *self)
 {
 	struct task_temp_t *self_temp = (struct task_temp_t *)self;
 
+	sysfs_attr_close (&self_temp->value_attr);
 	task_fini (&self_temp->task);
 
 	free (self_temp);
@@ -35,17 +38,15 @@ static void task_temp_fini (struct task_t *self)
 static unsigned task_temp_run (struct task_t *self)
 {
 	struct task_temp_t *self_temp = (struct task_temp_t *)self;
-	char *tmp;
+	char tmp [32];
 	int temp;
 
 	trace ("%s: run\n", self->instance);
 
-	tmp = sysfs_read (self_temp->value);
-	if (tmp == NULL)
+	if (sysfs_attr_read (&self_temp->value_attr, tmp, sizeof (tmp)) <= 0)
 		return 10000;
 
 	temp = strtol (tmp, NULL, 0) / self_temp->divider;
-	free (tmp);
 
 	if (self_temp->display) {
 		char buff [20];
@@ -72,9 +73,13 @@ struct task_t *task_temp_new (const char *instance)
 	self->format = cfg_get_str (instance, "format", DEFAULT_TEMP_FORMAT);
 	self->divider = cfg_get_int (instance, "divider", DEFAULT_TEMP_DIVIDER);
 	self->priority = cfg_get_int (instance, "priority", DEFAULT_PRIORITY);
+	self->task.slack_ms = cfg_get_int (instance, "slack", DEFAULT_TEMP_SLACK);
 
-	trace ("	format '%s' priority %d display '%s' value '%s'\n",
-		self->format, self->priority, self->display_task, self->value);
+	trace ("	format '%s' priority %d display '%s' value '%s' slack %u\n",
+		self->format, self->priority, self->display_task, self->value,
+		self->task.slack_ms);
+
+	sysfs_attr_open (&self->value_attr, NULL, self->value, O_RDONLY);
 
 	return &self->task;
 }
@@ -7,12 +7,44 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
 #include "vfdd.h"
 #include "task.h"
 
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+
 static struct task_t *g_tasks = NULL;
 struct timeval g_time;
+uint64_t g_clock;
+
+/* binary min-heap of tasks ordered by deadline */
+static struct task_t **g_heap = NULL;
+static unsigned g_heap_size = 0;
+/* set by task_attention(), tells some task needs attention */
+static uint8_t g_attention;
+
+/* the wakeup coalescing grid step in microseconds, 0 if disabled */
+static uint64_t g_grid = 0;
+/* the offset of the grid from g_clock, keeps grid aligned to wall clock */
+static uint64_t g_grid_offset = 0;
+
+/* the epoll set the dispatcher sleeps on */
+static int g_epoll = -1;
+/* the timer which expires when next task is due */
+static int g_timer = -1;
+/* the realtime timer cancelled by the kernel whenever wall clock is set */
+static int g_settime = -1;
+
+/* dispatcher-owned watches, recognized by address in tasks_run() */
+static struct task_watch_t g_timer_watch;
+static struct task_watch_t g_settime_watch;
 
 /* declare task constructors below */
 
@@ -69,9 +101,75 @@ void task_fini (struct task_t *self)
 {
 	trace ("finalizing '%s' plugin\n", self->instance);
 
+	while (self->watches)
+		task_unwatch_fd (self, self->watches->fd);
+
 	free (self->instance);
 }
 
+int task_due (struct task_t *self)
+{
+	return self->deadline <= g_clock;
+}
+
+void task_attention (struct task_t *self)
+{
+	/* everything runs in the dispatcher, which checks
+	 * attention flags before going to sleep */
+	self->attention = 1;
+	g_attention = 1;
+}
+
+static int epoll_watch (struct task_watch_t *watch, unsigned events)
+{
+	struct epoll_event ev;
+
+	memset (&ev, 0, sizeof (ev));
+	ev.events = events;
+	ev.data.ptr = watch;
+
+	if (epoll_ctl (g_epoll, EPOLL_CTL_ADD, watch->fd, &ev) < 0)
+		return -errno;
+
+	return 0;
+}
+
+int task_watch_fd (struct task_t *self, int fd, unsigned events,
+	void (*handler) (struct task_t *self, int fd, unsigned events))
+{
+	int ret;
+	struct task_watch_t *watch = calloc (1, sizeof (struct task_watch_t));
+
+	watch->task = self;
+	watch->fd = fd;
+	watch->handler = handler;
+
+	if ((ret = epoll_watch (watch, events)) < 0) {
+		fprintf (stderr, "%s: failed to watch fd %d\n", self->instance, fd);
+		free (watch);
+		return ret;
+	}
+
+	watch->next = self->watches;
+	self->watches = watch;
+
+	return 0;
+}
+
+void task_unwatch_fd (struct task_t *self, int fd)
+{
+	struct task_watch_t **cur;
+
+	for (cur = &self->watches; *cur; cur = &(*cur)->next)
+		if ((*cur)->fd == fd) {
+			struct task_watch_t *watch = *cur;
+			epoll_ctl (g_epoll, EPOLL_CTL_DEL, fd, NULL);
+			*cur = watch->next;
+			free (watch);
+			return;
+		}
+}
+
 struct task_t *task_find (const char *instance)
 {
 	struct task_t *cur;
@@ -83,12 +181,314 @@ struct task_t *task_find (const char *instance)
 	return NULL;
 }
 
+static void heap_set (unsigned idx, struct task_t *task)
+{
+	g_heap [idx] = task;
+	task->heap_index = idx;
+}
+
+/* move the task at given heap index up, towards earlier deadlines */
+static void heap_sift_up (unsigned idx)
+{
+	struct task_t *task = g_heap [idx];
+
+	while (idx > 0) {
+		unsigned parent = (idx - 1) / 2;
+		if (g_heap [parent]->deadline <= task->deadline)
+			break;
+		heap_set (idx, g_heap [parent]);
+		idx = parent;
+	}
+
+	heap_set (idx, task);
+}
+
+/* move the task at given heap index down, towards later deadlines */
+static void heap_sift_down (unsigned idx)
+{
+	struct task_t *task = g_heap [idx];
+
+	for (;;) {
+		unsigned child = idx * 2 + 1;
+		if (child >= g_heap_size)
+			break;
+		if ((child + 1 < g_heap_size) &&
+		    (g_heap [child + 1]->deadline < g_heap [child]->deadline))
+			child++;
+		if (task->deadline <= g_heap [child]->deadline)
+			break;
+		heap_set (idx, g_heap [child]);
+		idx = child;
+	}
+
+	heap_set (idx, task);
+}
+
+static void heap_insert (struct task_t *task)
+{
+	g_heap = realloc (g_heap, (g_heap_size + 1) * sizeof (struct task_t *));
+	heap_set (g_heap_size++, task);
+	heap_sift_up (task->heap_index);
+}
+
+/* get current CLOCK_MONOTONIC time in microseconds */
+static uint64_t clock_now ()
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* refresh g_clock and g_time */
+static void clock_update ()
+{
+	g_clock = clock_now ();
+	gettimeofday (&g_time, NULL);
+
+	if (g_grid) {
+		uint64_t wall = (uint64_t)g_time.tv_sec * 1000000 + g_time.tv_usec;
+		g_grid_offset = (wall % g_grid + g_grid - g_clock % g_grid) % g_grid;
+	}
+}
+
+/* compute the deadline of a task which wants to run after 'ms' milliseconds */
+static uint64_t task_deadline (struct task_t *task, unsigned ms)
+{
+	uint64_t deadline = g_clock + (uint64_t)ms * 1000;
+	uint64_t slack = (uint64_t)task->slack_ms * 1000;
+	uint64_t prev, next;
+
+	if (!g_grid || !slack)
+		return deadline;
+
+	/* move the deadline to the nearest grid point within task's
+	 * tolerance window, so that tasks due at about the same time
+	 * share a wakeup */
+	prev = deadline - (deadline + g_grid_offset) % g_grid;
+	next = (prev == deadline) ? prev : prev + g_grid;
+
+	if ((prev > g_clock) && (deadline - prev <= slack) && (deadline - prev < next - deadline))
+		return prev;
+	if (next - deadline <= slack)
+		return next;
+
+	return deadline;
+}
+
+/* count a value in a log2 histogram */
+static void stats_hist (unsigned *hist, uint64_t value)
+{
+	unsigned bucket = 0;
+
+	while ((value >>= 1) && (bucket < TASK_STATS_BUCKETS - 1))
+		bucket++;
+
+	hist [bucket]++;
+}
+
+void task_rearm (struct task_t *self, unsigned ms)
+{
+	self->deadline = task_deadline (self, ms);
+	heap_sift_up (self->heap_index);
+	heap_sift_down (self->heap_index);
+}
+
+/* run the task, accounting everything in task statistics */
+static unsigned task_run (struct task_t *task)
+{
+	struct task_stats_t *stats = &task->stats;
+	unsigned long syscalls = g_sysfs_syscalls;
+	unsigned long allocs = g_allocs;
+	uint64_t start = clock_now ();
+	uint64_t t;
+	unsigned ret;
+
+	if (task_due (task)) {
+		t = (start > task->deadline) ? start - task->deadline : 0;
+		stats->due++;
+		stats->late_total += t;
+		if (stats->late_max < t)
+			stats->late_max = t;
+		stats_hist (stats->late_hist, t);
+	}
+
+	ret = task->run (task);
+
+	t = clock_now () - start;
+	stats->calls++;
+	stats->run_total += t;
+	if (stats->run_max < t)
+		stats->run_max = t;
+	stats_hist (stats->run_hist, t);
+	stats->syscalls += g_sysfs_syscalls - syscalls;
+	stats->allocs += g_allocs - allocs;
+
+	return ret;
+}
+
+static void stats_dump_hist (FILE *f, const char *title, unsigned *hist)
+{
+	int i;
+
+	fprintf (f, "	%s:", title);
+	for (i = 0; i < TASK_STATS_BUCKETS - 1; i++)
+		if (hist [i])
+			fprintf (f, " <%luus:%u", 2UL << i, hist [i]);
+	if (hist [i])
+		fprintf (f, " >=%luus:%u", 1UL << i, hist [i]);
+	fprintf (f, "\n");
+}
+
+void tasks_dump_stats (FILE *f)
+{
+	struct task_t *cur;
+
+#ifdef ALLOC_STATS
+	fprintf (f, "heap allocations %lu\n", g_allocs);
+#endif
+
+	for (cur = g_tasks; cur; cur = cur->next) {
+		struct task_stats_t *stats = &cur->stats;
+
+		fprintf (f, "%s: calls %lu syscalls %lu ", cur->instance, stats->calls, stats->syscalls);
+#ifdef ALLOC_STATS
+		fprintf (f, "allocs %lu ", stats->allocs);
+#endif
+		fprintf (f, "run avg %lluus max %lluus, due %lu late avg %lluus max %lluus\n",
+			stats->calls ? (unsigned long long)(stats->run_total / stats->calls) : 0ULL,
+			(unsigned long long)stats->run_max, stats->due,
+			stats->due ? (unsigned long long)(stats->late_total / stats->due) : 0ULL,
+			(unsigned long long)stats->late_max);
+		stats_dump_hist (f, "run time", stats->run_hist);
+		stats_dump_hist (f, "lateness", stats->late_hist);
+	}
+}
+
+/* set up wakeup coalescing from config */
+static void coalesce_init ()
+{
+	struct task_t *cur;
+	unsigned slack = ~0U;
+
+	g_grid = (uint64_t)cfg_get_int (NULL, "coalesce", DEFAULT_COALESCE) * 1000;
+
+	/* without coalescing, wakeup timing stays exactly as it was */
+	if (!g_grid) {
+		trace ("wakeup coalescing disabled\n");
+		return;
+	}
+
+	/* let the kernel delay our timer as much as the least tolerant task permits */
+	for (cur = g_tasks; cur; cur = cur->next)
+		if (slack > cur->slack_ms)
+			slack = cur->slack_ms;
+
+	if ((slack != ~0U) && (slack != 0))
+		prctl (PR_SET_TIMERSLACK, (unsigned long)slack * 1000000, 0, 0, 0);
+
+	trace ("coalesce grid %u ms, timer slack %u ms\n",
+		(unsigned)(g_grid / 1000), (slack != ~0U) ? slack : 0);
+}
+
+/* (re)arm the timer noticing wall clock steps, a day from now */
+static void settime_arm ()
+{
+	struct itimerspec its;
+	struct timespec now;
+
+	memset (&its, 0, sizeof (its));
+	clock_gettime (CLOCK_REALTIME, &now);
+	its.it_value.tv_sec = now.tv_sec + 24 * 60 * 60;
+
+	timerfd_settime (g_settime, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL);
+}
+
+/* wall clock was set (or a day has passed), wake up all tasks */
+static void settime_handle ()
+{
+	uint64_t count;
+	unsigned i;
+
+	if ((read (g_settime, &count, sizeof (count)) < 0) && (errno == ECANCELED))
+		trace ("wall clock set, waking up all tasks\n");
+
+	settime_arm ();
+
+	/* all the deadlines become equal, which keeps the heap valid */
+	for (i = 0; i < g_heap_size; i++)
+		g_heap [i]->deadline = g_clock;
+}
+
+static int dispatcher_init ()
+{
+	g_epoll = epoll_create1 (EPOLL_CLOEXEC);
+	g_timer = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if ((g_epoll < 0) || (g_timer < 0))
+		goto error;
+
+	g_timer_watch.fd = g_timer;
+	if (epoll_watch (&g_timer_watch, EPOLLIN) < 0)
+		goto error;
+
+	/* tasks sleeping until a wall clock time (like the clock waiting for
+	 * next minute) would be late after a wall clock step; optional,
+	 * since older kernels don't support TFD_TIMER_CANCEL_ON_SET */
+	g_settime = timerfd_create (CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (g_settime >= 0) {
+		g_settime_watch.fd = g_settime;
+		settime_arm ();
+		if (epoll_watch (&g_settime_watch, EPOLLIN) < 0) {
+			close (g_settime);
+			g_settime = -1;
+		}
+	}
+
+	return 0;
+
+error:
+	fprintf (stderr, "failed to set up the dispatcher: %s\n", strerror (errno));
+	return -errno;
+}
+
+static void dispatcher_fini ()
+{
+	if (g_settime >= 0)
+		close (g_settime);
+	if (g_timer >= 0)
+		close (g_timer);
+	if (g_epoll >= 0)
+		close (g_epoll);
+
+	g_settime = g_timer = g_epoll = -1;
+}
+
+/* arm the dispatcher timer to expire at the earliest task deadline */
+static void dispatcher_arm ()
+{
+	struct itimerspec its;
+
+	memset (&its, 0, sizeof (its));
+	if (g_heap_size) {
+		uint64_t deadline = g_heap [0]->deadline;
+		its.it_value.tv_sec = deadline / 1000000;
+		its.it_value.tv_nsec = (deadline % 1000000) * 1000;
+	}
+
+	timerfd_settime (g_timer, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
 int tasks_init ()
 {
-	char *tsk = strdup (cfg_get_str (NULL, "tasks", DEFAULT_TASKS));
+	char *tsk;
 	char *tok, *save;
 	struct task_t *cur;
+	int ret;
+
+	if ((ret = dispatcher_init ()) < 0)
+		return ret;
 
+	tsk = strdup (cfg_get_str (NULL, "tasks", DEFAULT_TASKS));
 	for (tok = strtok_r (tsk, g_spaces, &save); tok != NULL; tok = strtok_r (NULL, g_spaces, &save)) {
 		int i, ok = 0;
 
@@ -114,63 +514,84 @@ int tasks_init ()
 		if (cur->post_init)
 			cur->post_init (cur);
 
+	coalesce_init ();
+
+	/* all tasks are due right away */
+	clock_update ();
+	for (cur = g_tasks; cur; cur = cur->next) {
+		cur->deadline = g_clock;
+		heap_insert (cur);
+	}
+
 	return 0;
 }
 
 void tasks_run ()
 {
 	struct task_t *cur;
-	struct timeval tv;
-
-	gettimeofday (&g_time, NULL);
+	struct epoll_event events [8];
+	sigset_t set, sleep_set;
+	uint64_t count;
+	int i, n;
+
+	/* the signals setting g_shutdown & g_dump_stats are only delivered
+	 * while we sleep, so they can't slip in between checking the flags
+	 * and going to sleep */
+	sigemptyset (&set);
+	sigaddset (&set, SIGINT);
+	sigaddset (&set, SIGQUIT);
+	sigaddset (&set, SIGTERM);
+	sigaddset (&set, SIGUSR1);
+	sigprocmask (SIG_BLOCK, &set, &sleep_set);
+
+	clock_update ();
 
 	while (!g_shutdown) {
-		/* sleep no more than 10 seconds */
-		unsigned sleep_time = 10000;
-
-		/* run all tasks which are ready to run
-		 * until we're left with no ready tasks
-		 */
-		int ready = 1;
-		while (ready) {
-			ready = 0;
-
-
-			/* run all ready-to-run tasks */
-			for (cur = g_tasks; cur; cur = cur->next) {
-				if (cur->sleep_ms == 0) {
-					cur->sleep_ms = cur->run (cur);
-				} else if (cur->attention) {
-					cur->attention = 0;
-					cur->run (cur);
-				}
-				if (sleep_time > cur->sleep_ms)
-					sleep_time = cur->sleep_ms;
+		for (;;) {
+			/* run all tasks whose deadline has come */
+			while (g_heap_size && task_due (cur = g_heap [0])) {
+				cur->attention = 0;
+				cur->deadline = task_deadline (cur, task_run (cur));
+				heap_sift_down (0);
 			}
 
-			/* check if there are more ready-to-run tasks */
+			if (!g_attention)
+				break;
+
+			/* run tasks which asked for attention */
+			g_attention = 0;
 			for (cur = g_tasks; cur; cur = cur->next)
-				if (cur->attention || (cur->sleep_ms == 0)) {
-					ready = 1;
-					break;
+				if (cur->attention) {
+					cur->attention = 0;
+					task_run (cur);
 				}
 		}
 
-		usleep (sleep_time * 1000);
+		dispatcher_arm ();
+
+		n = epoll_pwait (g_epoll, events, ARRAY_SIZE (events), -1, &sleep_set);
 
-		/* find out how much we actually slept */
-		tv = g_time;
-		gettimeofday (&g_time, NULL);
+		clock_update ();
+
+		if (g_dump_stats) {
+			g_dump_stats = 0;
+			dump_stats ();
+		}
 
-		sleep_time = ((g_time.tv_sec & 255) * 1000 + g_time.tv_usec / 1000) - 
-			((tv.tv_sec & 255) * 1000 + tv.tv_usec / 1000);
+		for (i = 0; i < n; i++) {
+			struct task_watch_t *watch = events [i].data.ptr;
 
-		for (cur = g_tasks; cur; cur = cur->next)
-			if (cur->sleep_ms > sleep_time)
-				cur->sleep_ms -= sleep_time;
+			if (watch == &g_timer_watch)
+				/* just reset the event counter */
+				read (watch->fd, &count, sizeof (count));
+			else if (watch == &g_settime_watch)
+				settime_handle ();
 			else
-				cur->sleep_ms = 0;
+				watch->handler (watch->task, watch->fd, events [i].events);
+		}
 	}
+
+	sigprocmask (SIG_SETMASK, &sleep_set, NULL);
 }
 
 void tasks_fini ()
@@ -183,4 +604,10 @@ void tasks_fini ()
 		(*cur)->fini (*cur);
 		*cur = next;
 	}
+
+	free (g_heap);
+	g_heap = NULL;
+	g_heap_size = 0;
+
+	dispatcher_fini ();
 }
@@ -8,6 +8,52 @@
 #include <stdint.h>
 #include <sys/time.h>
 
+struct task_t;
+
+/* number of log2 buckets in task histograms */
+#define TASK_STATS_BUCKETS	20
+
+/* task performance counters, maintained by the dispatcher */
+struct task_stats_t {
+	/* number of run() calls */
+	unsigned long calls;
+	/* number of syscalls made by sysfs helpers during run() */
+	unsigned long syscalls;
+	/* number of heap allocations during run() */
+	unsigned long allocs;
+	/* total and maximal run() duration in microseconds */
+	uint64_t run_total, run_max;
+	/* number of runs by duration, bucket N counts runs of [2^N, 2^(N+1)) us */
+	unsigned run_hist [TASK_STATS_BUCKETS];
+	/* number of runs due to expired deadline */
+	unsigned long due;
+	/* total and maximal run() start delay past deadline, microseconds */
+	uint64_t late_total, late_max;
+	/* number of runs by start delay, buckets as in run_hist */
+	unsigned late_hist [TASK_STATS_BUCKETS];
+};
+
+/* a file descriptor watched by the dispatcher on behalf of a task */
+struct task_watch_t {
+	/* next watch of the same task, or NULL */
+	struct task_watch_t *next;
+	/* the task owning this watch */
+	struct task_t *task;
+	/* the watched file descriptor */
+	int fd;
+
+	/**
+	 * called from the dispatcher when the file descriptor becomes ready.
+	 * @arg self
+	 *	the task owning the file descriptor
+	 * @arg fd
+	 *	the file descriptor
+	 * @arg events
+	 *	a combination of EPOLLXXX flags
+	 */
+	void (*handler) (struct task_t *self, int fd, unsigned events);
+};
+
 /*
  * ANSI C OOP.
  * this is the base class for all tasks.
@@ -19,11 +65,23 @@ struct task_t {
 	/* task instance name */
 	char *instance;
 
-	/* number of milliseconds of sleep left */
-	unsigned sleep_ms;
+	/* absolute CLOCK_MONOTONIC time (in microseconds) when task is due */
+	uint64_t deadline;
+
+	/* task position in the dispatcher's deadline heap */
+	unsigned heap_index;
+
+	/* how many milliseconds the task may be run before or after its deadline */
+	unsigned slack_ms;
+
+	/* performance counters */
+	struct task_stats_t stats;
 
-	/* this can be asynchronously set to non-zero when task suddenly requires attention */
-	volatile uint8_t attention;
+	/* set to non-zero by task_attention() when task suddenly requires attention */
+	uint8_t attention;
+
+	/* file descriptors watched on behalf of this task */
+	struct task_watch_t *watches;
 
 	/**
 	 * do whatever this task does.
@@ -31,7 +89,8 @@ struct task_t {
 	 *	a pointer to this task
 	 * @return
 	 *	returns number of milliseconds after which dispatcher calls
-	 *	this method the next time.
+	 *	this method the next time, or TASK_NEVER to be run only on
+	 *	attention requests.
 	 */
 	unsigned (*run) (struct task_t *self);
 
@@ -61,11 +120,70 @@ struct task_t {
 	void (*display_notify) (struct task_t *self, int active);
 };
 
+/* run() return value for tasks that have nothing to do until asked for attention */
+#define TASK_NEVER		(~0U)
+
 /* current time, maintained by task manager */
 extern struct timeval g_time;
+/* current CLOCK_MONOTONIC time in microseconds, maintained by task manager */
+extern uint64_t g_clock;
 
 extern void task_init (struct task_t *self, const char *instance);
 extern struct task_t *task_find (const char *instance);
 extern void task_fini (struct task_t *self);
 
+/**
+ * Check why the task is being run.
+ * @arg self
+ *	the task being run
+ * @return
+ *	non-zero if task's deadline expired, 0 if it is run due to an
+ *	attention request.
+ */
+extern int task_due (struct task_t *self);
+
+/**
+ * Request the dispatcher to call task's run() method as soon as possible.
+ * Must be called from the dispatcher, e.g. from a task method or fd handler.
+ * @arg self
+ *	the task that requires attention
+ */
+extern void task_attention (struct task_t *self);
+
+/**
+ * Change the time when the dispatcher calls task's run() method next.
+ * Must not be called from run() when the task is due, as the value
+ * returned by run() sets the next deadline then.
+ * @arg self
+ *	the task to reschedule
+ * @arg ms
+ *	number of milliseconds from now, or TASK_NEVER
+ */
+extern void task_rearm (struct task_t *self, unsigned ms);
+
+/**
+ * Ask the dispatcher to watch a file descriptor on behalf of a task.
+ * @arg self
+ *	the task that will handle the events
+ * @arg fd
+ *	the file descriptor to watch
+ * @arg events
+ *	a combination of EPOLLXXX flags
+ * @arg handler
+ *	the function to call when the file descriptor becomes ready
+ * @return
+ *	0 on success, -errno on error
+ */
+extern int task_watch_fd (struct task_t *self, int fd, unsigned events,
+	void (*handler) (struct task_t *self, int fd, unsigned events));
+
+/**
+ * Stop watching a file descriptor previously passed to task_watch_fd().
+ * @arg self
+ *	the task owning the file descriptor
+ * @arg fd
+ *	the file descriptor
+ */
+extern void task_unwatch_fd (struct task_t *self, int fd);
+
 #endif /* __TASK_H__ */
@@ -11,16 +11,20 @@
 #include <signal.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <limits.h>
 
 #include "vfdd.h"
 
 const char *g_version = "0.1.0";
 const char *g_config = "/etc/vfdd.ini";
 const char *g_pidfile = "/var/run/vfdd.pid";
+const char *g_statsfile = "/var/run/vfdd.stats";
 int g_verbose = 0;
 int g_daemon = 0;
 int g_kill_daemon = 0;
+int g_query_stats = 0;
 volatile int g_shutdown = 0;
+volatile int g_dump_stats = 0;
 const char *g_spaces = " \t";
 
 // the global config
@@ -38,6 +42,8 @@ static void show_help (char *const *argv)
 	printf ("	-D	daemonize the program\n");
 	printf ("	-p FILE	write PID to file when running as daemon\n");
 	printf ("	-k	kill the running daemon\n");
+	printf ("	-s	display task statistics of the running daemon\n");
+	printf ("	-S FILE	write statistics to file when running as daemon\n");
 	printf ("	-h	display this help\n");
 	printf ("	-v	verbose info about what's cooking\n");
 	printf ("	-V	display program version\n");
@@ -68,6 +74,35 @@ static void signal_handler (int sig)
 	g_shutdown = 1;
 }
 
+static void stats_signal_handler (int sig)
+{
+	g_dump_stats = 1;
+}
+
+void dump_stats ()
+{
+	char tmp [PATH_MAX];
+	FILE *f;
+
+	if (!g_daemon) {
+		tasks_dump_stats (stdout);
+		fflush (stdout);
+		return;
+	}
+
+	/* the file appears complete or not at all */
+	snprintf (tmp, sizeof (tmp), "%s.tmp", g_statsfile);
+	f = fopen (tmp, "w");
+	if (!f)
+		return;
+
+	tasks_dump_stats (f);
+	if (fclose (f) == 0)
+		rename (tmp, g_statsfile);
+	else
+		unlink (tmp);
+}
+
 static int load_config (const char *config)
 {
 	int ret;
@@ -115,7 +150,7 @@ static void daemonize ()
 	close (2);
 }
 
-static int kill_daemon ()
+static int signal_daemon (int sig)
 {
 	char tmp [11];
 	int h, n, ok = -1;
@@ -132,22 +167,50 @@ static int kill_daemon ()
 		tmp [n] = 0;
 		pid = strtoul (tmp, NULL, 0);
 		if (pid > 1)
-			ok = kill (pid, SIGINT);
+			ok = kill (pid, sig);
 	}
 
 	close (h);
 
 	if (ok != 0)
-		fprintf (stderr, "failed to kill daemon pid %d\n", pid);
+		fprintf (stderr, "failed to signal daemon pid %d\n", pid);
 
 	return ok;
 }
 
+static int query_stats ()
+{
+	char tmp [256];
+	int h, n, i;
+
+	unlink (g_statsfile);
+	if (signal_daemon (SIGUSR1) != 0)
+		return -1;
+
+	/* wait up to a second for the daemon to write the statistics */
+	for (i = 0; i < 10; i++) {
+		usleep (100000);
+		if ((h = open (g_statsfile, O_RDONLY)) >= 0)
+			break;
+	}
+
+	if (h < 0) {
+		fprintf (stderr, "daemon did not write statistics to '%s'\n", g_statsfile);
+		return -1;
+	}
+
+	while ((n = read (h, tmp, sizeof (tmp))) > 0)
+		fwrite (tmp, 1, n, stdout);
+
+	close (h);
+	return 0;
+}
+
 int main (int argc, char *const *argv)
 {
 	int ret;
 
-	while ((ret = getopt (argc, argv, "Dp:khvV")) >= 0)
+	while ((ret = getopt (argc, argv, "Dp:ksS:hvV")) >= 0)
 		switch (ret) {
 			case 'D':
 				g_daemon = 1;
@@ -161,6 +224,14 @@ int main (int argc, char *const *argv)
 				g_kill_daemon = 1;
 				break;
 
+			case 's':
+				g_query_stats = 1;
+				break;
+
+			case 'S':
+				g_statsfile = optarg;
+				break;
+
 			case 'v':
 				g_verbose = 1;
 				break;
@@ -175,7 +246,10 @@ int main (int argc, char *const *argv)
 		}
 
 	if (g_kill_daemon)
-		return kill_daemon ();
+		return signal_daemon (SIGINT);
+
+	if (g_query_stats)
+		return query_stats ();
 
 	if (g_daemon)
 		daemonize ();
@@ -197,6 +271,7 @@ configured:
 	signal (SIGQUIT, signal_handler);
 	signal (SIGKILL, signal_handler);
 	signal (SIGTERM, signal_handler);
+	signal (SIGUSR1, stats_signal_handler);
 
 	tasks_run ();
 
@@ -208,8 +283,10 @@ leave:
 	if (g_cfg)
 		cfg_free (g_cfg);
 
-	if (g_daemon)
+	if (g_daemon) {
 		unlink (g_pidfile);
+		unlink (g_statsfile);
+	}
 
 	return ret;
 }
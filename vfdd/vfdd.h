@@ -5,32 +5,43 @@
 #ifndef __VFDD_H__
 #define __VFDD_H__
 
+#include <stdio.h>
 #include "cfg_parse.h"
 
 // default settings for various task modules
 
 #define DEFAULT_PRIORITY	100
+#define DEFAULT_COALESCE	0
 #define DEFAULT_DEVICE		"/sys/bus/platform/devices/meson-vfd.14"
 #define DEFAULT_BRIGHTNESS	50
 #define DEFAULT_TASKS		"clock"
 #define DEFAULT_DISPLAY		"display"
 #define DEFAULT_DISPLAY_QUANTUM	5000
+#define DEFAULT_DISPLAY_SLACK	100
 #define DEFAULT_CLOCK_FORMAT	"%H%M"
 #define DEFAULT_CLOCK_SEPARATOR	":"
+#define DEFAULT_CLOCK_SLACK	10
 #define DEFAULT_TEMP_VALUE	"/sys/devices/virtual/thermal/thermal_zone0/temp"
 #define DEFAULT_TEMP_FORMAT	"t%02d*"
 #define DEFAULT_TEMP_DIVIDER	1000
+#define DEFAULT_TEMP_SLACK	250
 #define DEFAULT_DISK_DEVICE	"sda"
 #define DEFAULT_DISK_FIELD	4
 #define DEFAULT_DISK_THRESHOLD	50
 #define DEFAULT_DISK_INDICATOR	"USB"
+#define DEFAULT_DISK_SLACK	125
 #define DEFAULT_DOT_ATTR	"/sys/class/switch/hdmi/state"
 #define DEFAULT_DOT_FIELD	1
 #define DEFAULT_DOT_THRESHOLD	1
 #define DEFAULT_DOT_INDICATOR	"HDMI"
+#define DEFAULT_DOT_SLACK	250
 #define DEFAULT_SUSPEND_TEXT	"*  *"
 #define DEFAULT_SUSPEND_INDICATORS ""
 #define DEFAULT_SUSPEND_BRIGHTNESS 10
+#define DEFAULT_SUSPEND_SLACK	1000
+#define DEFAULT_SHUTDOWN_TEXT	""
+#define DEFAULT_SHUTDOWN_INDICATORS ""
+#define DEFAULT_SHUTDOWN_BRIGHTNESS 0
 
 
 #define ARRAY_SIZE(x)		(sizeof (x) / sizeof (x [0]))
@@ -41,6 +52,8 @@ extern struct cfg_struct *g_cfg;
 extern int g_verbose;
 // set asynchronously to 1 to initiate shutdown
 extern volatile int g_shutdown;
+// set asynchronously to 1 to dump task statistics
+extern volatile int g_dump_stats;
 
 // trace calls if g_verbose != 0
 extern void trace (const char *format, ...);
@@ -51,13 +64,20 @@ extern const char *g_spaces;
 extern int tasks_init ();
 extern void tasks_run ();
 extern void tasks_fini ();
+extern void tasks_dump_stats (FILE *f);
+// write task statistics where the user expects them
+extern void dump_stats ();
 
 /* superstructure on cfg_parse */
 extern const char *cfg_get_str (const char *instance, const char *key, const char *defval);
 extern int cfg_get_int (const char *instance, const char *key, int defval);
 extern int cfg_get_int_2 (const char *instance, const char *key, int *out);
 
+/* number of heap allocations, always 0 without ALLOC_STATS, see alloc.c */
+extern unsigned long g_allocs;
+
 /* helper functions for sysfs */
+extern unsigned long g_sysfs_syscalls;
 extern char *sysfs_read (const char *device_attr);
 extern char *sysfs_get_str (const char *device, const char *attr);
 extern int sysfs_get_int (const char *device, const char *attr);
@@ -68,4 +88,49 @@ extern int sysfs_set_int (const char *device, const char *attr, int value);
 
 extern int sysfs_exists (const char *device_attr);
 
+/* a sysfs attribute which is kept open between accesses */
+struct sysfs_attr_t {
+	/* full path to the attribute */
+	char *path;
+	/* file handle, -1 if attribute could not be opened yet */
+	int fd;
+	/* O_RDONLY or O_WRONLY */
+	int mode;
+};
+
+/**
+ * Open a sysfs attribute for repeated access.
+ * If the attribute is not available right now, it will be re-opened
+ * on every access until it appears.
+ * @arg attr
+ *	the attribute handle to initialize
+ * @arg device
+ *	the device directory, or NULL if name contains the full path
+ * @arg name
+ *	attribute name
+ * @arg mode
+ *	O_RDONLY or O_WRONLY
+ * @return
+ *	0 if attribute has been opened, -1 otherwise
+ */
+extern int sysfs_attr_open (struct sysfs_attr_t *attr, const char *device, const char *name, int mode);
+extern void sysfs_attr_close (struct sysfs_attr_t *attr);
+
+/**
+ * Read the whole attribute into a caller-provided buffer.
+ * @return
+ *	number of bytes read (buffer is zero-terminated), or -1 on error
+ */
+extern int sysfs_attr_read (struct sysfs_attr_t *attr, char *buff, int size);
+extern int sysfs_attr_get_int (struct sysfs_attr_t *attr);
+
+/**
+ * Write the value to the attribute.
+ * @return
+ *	0 on success, -1 on error
+ */
+extern int sysfs_attr_write (struct sysfs_attr_t *attr, const char *value, int len);
+extern int sysfs_attr_set_str (struct sysfs_attr_t *attr, const char *value);
+extern int sysfs_attr_set_int (struct sysfs_attr_t *attr, int value);
+
 #endif /* __VFDD_H__ */